@@ -0,0 +1,461 @@
+// Host benchmarks for the firmware hot paths. Build with the host CMake target
+// and run `elmer_bench [filter]`.
+#include <eventlog.h>
+#include <LittleFS.h>
+#include <logexport.h>
+#include <metrics.h>
+#include <multisensor.h>
+#include <scheduler.h>
+#include <sensor.h>
+#include <shim.h>
+
+#include <vector>
+
+#include "benchmark.h"
+
+#define SENSOR_PIN      D6
+#define IRQ_SENSOR_PIN  D7
+
+// Globals like on the device, so members start zeroed before the constructor runs
+Sensor _pollingSensor(SENSOR_PIN, 30);
+Sensor _irqSensor(IRQ_SENSOR_PIN, 30, Sensor::INTERRUPT);
+
+static const uint8_t _meterPins[] = { D1, D2, D5, D6 };
+MultiSensor _multiSensor(_meterPins, 4, 15, 30, 256 * 1024);
+Debouncer _meterDebouncers[] = { { D1, 15 }, { D2, 15 }, { D5, 15 }, { D6, 15 } };
+
+static void resetDevice()
+{
+  shim::resetFs();
+  shim::setMicros(0);
+  LittleFS.begin();
+  _events.emptyLogFile();
+}
+
+// One meter pulse every `periodMs`, held low for 30 ms with 1 ms of contact bounce
+static inline int meterLevel(uint64_t nowMicros, uint32_t periodMs)
+{
+  uint32_t phase = (nowMicros / 1000) % periodMs;
+  if (phase == 0)
+    return (nowMicros / 250) & 1;
+  return phase > 30;
+}
+
+static void BM_SensorUpdate_Idle(benchmark::State& state)
+{
+  resetDevice();
+  _pollingSensor.begin(INPUT_PULLUP);
+
+  for (auto _ : state) {
+    shim::advanceMicros(50);
+    _pollingSensor.update(time(nullptr));
+  }
+}
+BENCHMARK(BM_SensorUpdate_Idle);
+
+static void BM_SensorUpdate_Pulses(benchmark::State& state)
+{
+  resetDevice();
+  _pollingSensor.begin(INPUT_PULLUP);
+
+  for (auto _ : state) {
+    shim::advanceMicros(250);
+    shim::setPin(SENSOR_PIN, meterLevel(shim::nowMicros(), 100));
+    _pollingSensor.update(time(nullptr));
+  }
+}
+BENCHMARK(BM_SensorUpdate_Pulses);
+
+static void BM_SensorUpdate_Interrupt(benchmark::State& state)
+{
+  resetDevice();
+  _irqSensor.begin(INPUT_PULLUP);
+
+  for (auto _ : state) {
+    shim::advanceMicros(250);
+    shim::setPin(IRQ_SENSOR_PIN, meterLevel(shim::nowMicros(), 100));
+    _irqSensor.update(time(nullptr));
+  }
+  state.counters["overflows"] = _irqSensor.edgeOverflows();
+}
+BENCHMARK(BM_SensorUpdate_Interrupt);
+
+// Pulses timed into a capture: the varints go to flash in batches
+static void BM_SensorUpdate_Capture(benchmark::State& state)
+{
+  resetDevice();
+  _irqSensor.begin(INPUT_PULLUP);
+  _irqSensor.startCapture(SENSOR_CAPTURE_SEC);
+
+  for (auto _ : state) {
+    shim::advanceMicros(250);
+    shim::setPin(IRQ_SENSOR_PIN, meterLevel(shim::nowMicros(), 100));
+    _irqSensor.update(time(nullptr));
+  }
+  _irqSensor.stopCapture();
+  state.counters["bytes/pulse"] = (double)shim::fsStats().bytesWritten / (shim::nowMicros() / 100000);
+}
+BENCHMARK(BM_SensorUpdate_Capture);
+
+static void BM_SensorPower(benchmark::State& state)
+{
+  for (auto _ : state) {
+    float watts = _irqSensor.power();
+    benchmark::DoNotOptimize(watts);
+  }
+}
+BENCHMARK(BM_SensorPower);
+
+// Four meters pulsing at different rates: one register read per tick...
+static void BM_MultiSensorUpdate(benchmark::State& state)
+{
+  resetDevice();
+  _multiSensor.begin(INPUT_PULLUP);
+
+  for (auto _ : state) {
+    shim::advanceMicros(250);
+    for (uint8_t i = 0; i < 4; i++)
+      shim::setPin(_meterPins[i], meterLevel(shim::nowMicros(), 100 + 20 * i));
+    _multiSensor.update(time(nullptr));
+  }
+}
+BENCHMARK(BM_MultiSensorUpdate);
+
+// ...against a pin read and a debouncer per meter
+static void BM_DebouncerUpdate_FourMeters(benchmark::State& state)
+{
+  uint32_t counts[4] = {};
+
+  resetDevice();
+  for (Debouncer& debouncer : _meterDebouncers)
+    debouncer.begin(INPUT_PULLUP);
+
+  for (auto _ : state) {
+    shim::advanceMicros(250);
+    for (uint8_t i = 0; i < 4; i++)
+      shim::setPin(_meterPins[i], meterLevel(shim::nowMicros(), 100 + 20 * i));
+    for (uint8_t i = 0; i < 4; i++) {
+      _meterDebouncers[i].update();
+      counts[i] += _meterDebouncers[i].fell();
+    }
+  }
+  benchmark::DoNotOptimize(counts);
+}
+BENCHMARK(BM_DebouncerUpdate_FourMeters);
+
+// One pin through the virtual Debouncer, as Sensor used to...
+static void BM_DebouncerUpdate(benchmark::State& state)
+{
+  Debouncer* debouncer = &_meterDebouncers[0];
+  uint32_t counts = 0;
+
+  resetDevice();
+  debouncer->begin(INPUT_PULLUP);
+
+  for (auto _ : state) {
+    shim::advanceMicros(250);
+    shim::setPin(_meterPins[0], meterLevel(shim::nowMicros(), 100));
+    debouncer->update();
+    counts += debouncer->fell();
+  }
+  benchmark::DoNotOptimize(counts);
+}
+BENCHMARK(BM_DebouncerUpdate);
+
+// ...and through the inlined StaticDebouncer it uses now
+static void BM_StaticDebouncerUpdate(benchmark::State& state)
+{
+  StaticDebouncer<StablePolicy, 15> debouncer(_meterPins[0]);
+  uint32_t counts = 0;
+
+  resetDevice();
+  debouncer.begin(INPUT_PULLUP);
+
+  for (auto _ : state) {
+    shim::advanceMicros(250);
+    shim::setPin(_meterPins[0], meterLevel(shim::nowMicros(), 100));
+    debouncer.update();
+    counts += debouncer.fell();
+  }
+  benchmark::DoNotOptimize(counts);
+}
+BENCHMARK(BM_StaticDebouncerUpdate);
+
+// 32 bouncing inputs per tick, without the pins: the cost does not depend on the count
+static void BM_VerticalDebouncerUpdate(benchmark::State& state)
+{
+  VerticalDebouncer debouncer(15);
+  uint32_t inputs = 0, seed = 2463534242u, counts = 0;
+
+  debouncer.begin(inputs);
+  for (auto _ : state) {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    inputs ^= seed & seed >> 7 & seed >> 13;   // a few inputs change per tick
+    debouncer.update(inputs);
+    counts += __builtin_popcount(debouncer.fell());
+  }
+  benchmark::DoNotOptimize(counts);
+}
+BENCHMARK(BM_VerticalDebouncerUpdate);
+
+static void BM_EventLogLog(benchmark::State& state)
+{
+  resetDevice();
+
+  unsigned long n = 0;
+  for (auto _ : state) {
+    _events.log(EventLog::INFO, PSTR("Sensor: reset timestamp at %lu"), n++);
+    _events.update();
+  }
+
+  _events.sync();
+  state.counters["bytes/msg"] = (double)shim::fsStats().bytesWritten / state.iterations();
+  state.counters["flushes/msg"] = (double)shim::fsStats().flushes / state.iterations();
+}
+BENCHMARK(BM_EventLogLog);
+
+static void BM_EventLogLog_Binary(benchmark::State& state)
+{
+  resetDevice();
+  _events.begin(EventLog::BINARY);
+
+  uint64_t bytes = shim::fsStats().bytesWritten;
+  uint32_t flushes = shim::fsStats().flushes;
+  unsigned long n = 0;
+  for (auto _ : state) {
+    _events.log(EventLog::INFO, PSTR("Sensor: reset timestamp at %lu"), n++);
+    _events.update();
+  }
+
+  _events.sync();
+  state.counters["bytes/msg"] = (double)(shim::fsStats().bytesWritten - bytes) / state.iterations();
+  state.counters["flushes/msg"] = (double)(shim::fsStats().flushes - flushes) / state.iterations();
+  _events.begin(EventLog::TEXT);
+}
+BENCHMARK(BM_EventLogLog_Binary);
+
+// One simulated hour of a 1 kW load on a 1000 imp/kWh meter per iteration
+static void BM_SensorHour(benchmark::State& state)
+{
+  resetDevice();
+  _irqSensor.begin(INPUT_PULLUP);
+
+  uint64_t bytes = shim::fsStats().bytesWritten;
+  uint32_t flushes = shim::fsStats().flushes;
+
+  for (auto _ : state) {
+    for (uint32_t step = 0; step < 3600 * 1000; step++) {
+      shim::advanceMicros(1000);
+      shim::setPin(IRQ_SENSOR_PIN, meterLevel(shim::nowMicros(), 3600));
+      if (step % 100 == 0) {
+        _irqSensor.update(time(nullptr));
+      }
+    }
+  }
+
+  state.counters["bytes/hour"] = (double)(shim::fsStats().bytesWritten - bytes) / state.iterations();
+  state.counters["flushes/hour"] = (double)(shim::fsStats().flushes - flushes) / state.iterations();
+  state.counters["maxStallUs"] = _irqSensor.maxWriteStall();
+}
+BENCHMARK(BM_SensorHour);
+
+// A simulated day per iteration: the meter at 1 kW, an event every 15 minutes,
+// a warning every hour and an error a day. Reports what the shim's flash
+// cost model makes of it: commits, bytes programmed and blocks erased as
+// estimated from the flushes, not measured on LittleFS.
+static void BM_FlashModelDay(benchmark::State& state)
+{
+  resetDevice();
+  _events.begin(EventLog::BINARY);
+  _irqSensor.begin(INPUT_PULLUP);
+
+  shim::FsStats start = shim::fsStats();
+  uint32_t seconds = 0;
+
+  for (auto _ : state) {
+    for (uint32_t step = 0; step < 86400 * 1000; step++) {
+      shim::advanceMicros(1000);
+      shim::setPin(IRQ_SENSOR_PIN, meterLevel(shim::nowMicros(), 3600));
+      if (step % 100)
+        continue;
+
+      if (step % 1000 == 0) {
+        seconds++;
+        if (seconds % 900 == 0)
+          _events.log(EventLog::INFO, PSTR("Access Point stopped"));
+        if (seconds % 3600 == 1800)
+          _events.log(EventLog::WARN, PSTR("Sensor: reset timestamp at %lu"), (unsigned long)seconds);
+        if (seconds % 86400 == 43200)
+          _events.log(EventLog::ERROR, PSTR("Failed to write log index"));
+      }
+
+      _irqSensor.update(time(nullptr));
+      _events.update();
+    }
+  }
+
+  const shim::FsStats& end = shim::fsStats();
+  double days = state.iterations();
+  state.counters["commits/day"] = (end.commits - start.commits) / days;
+  state.counters["programKB/day"] = (end.programmed - start.programmed) / 1024.0 / days;
+  state.counters["erases/day"] = (end.erases - start.erases) / days;
+  state.counters["bytes/day"] = (end.bytesWritten - start.bytesWritten) / days;
+
+  _events.begin(EventLog::TEXT);
+}
+BENCHMARK(BM_FlashModelDay);
+
+// A week of 30 s intervals with a varying load, written straight through the codec
+static SegmentLog& benchLog()
+{
+  static SegmentLog log("/bench", 16 * 1024, 1024 * 1024);
+  uint8_t buffer[2 * LOG_MAX_RECORD];
+  LogEncoder encoder;
+
+  resetDevice();
+  log.begin(30);
+
+  for (uint32_t offset = 1; offset <= 7 * 2880; offset++) {
+    size_t len = 0;
+    if (offset % 120 == 1)
+      len = encoder.marker(buffer, 1735689600 + offset * 30);
+    len += encoder.entry(buffer + len, offset % 120 + 1, 10 + offset % 7);
+    log.write(buffer, len);
+  }
+  log.sync();
+  return log;
+}
+
+static void BM_LogExport_Raw(benchmark::State& state)
+{
+  SegmentLog& log = benchLog();
+  uint8_t buffer[1024];
+  size_t bytes = 0;
+
+  for (auto _ : state) {
+    SegmentReader reader(log, { log.first(), 0 }, log.end());
+    size_t n;
+    while ((n = reader.read(buffer, sizeof(buffer))) > 0)
+      bytes += n;
+  }
+  state.counters["MB/s"] = bytes / (state.elapsedNs() / 1e3);
+}
+BENCHMARK(BM_LogExport_Raw);
+
+static void BM_LogExport_Csv(benchmark::State& state)
+{
+  SegmentLog& log = benchLog();
+  uint8_t buffer[1024];
+  size_t bytes = 0;
+
+  for (auto _ : state) {
+    LogExport exporter(log, { log.first(), 0 }, log.end(), LogExport::CSV);
+    size_t n;
+    while ((n = exporter.read(buffer, sizeof(buffer))) > 0)
+      bytes += n;
+  }
+  state.counters["MB/s"] = bytes / (state.elapsedNs() / 1e3);
+}
+BENCHMARK(BM_LogExport_Csv);
+
+// A year of 30 s intervals with slowly varying counts, encoded in memory
+static const std::vector<uint8_t>& benchStream()
+{
+  static std::vector<uint8_t> stream;
+  if (!stream.empty())
+    return stream;
+
+  LogEncoder encoder;
+  uint8_t buffer[2 * LOG_MAX_RECORD];
+  uint16_t pulses = 10;
+
+  stream.resize(LogEncoder::header(buffer, 30));
+  memcpy(stream.data(), buffer, stream.size());
+  for (uint32_t offset = 0; offset < 365 * 2880; offset++) {
+    size_t len = 0;
+    if (offset % 2048 == 0)
+      len = encoder.marker(buffer, 1735689600 + offset * 30);
+    pulses += (offset * 7 % 5 == 0) - (offset * 11 % 7 == 0);
+    len += encoder.entry(buffer + len, offset % 2048 + 1, pulses);
+    stream.insert(stream.end(), buffer, buffer + len);
+  }
+  return stream;
+}
+
+static void BM_LogDecode_Next(benchmark::State& state)
+{
+  const std::vector<uint8_t>& stream = benchStream();
+  uint32_t sum = 0;
+
+  for (auto _ : state) {
+    LogDecoder decoder;
+    LogRecord record;
+    size_t pos = 0, n;
+    while ((n = decoder.next(stream.data() + pos, stream.size() - pos, record)) > 0) {
+      pos += n;
+      sum += record.pulses;
+    }
+  }
+  state.counters["MB/s"] = (double)stream.size() * state.iterations() / (state.elapsedNs() / 1e3);
+  state.counters["sum"] = sum;
+}
+BENCHMARK(BM_LogDecode_Next);
+
+static void BM_LogDecode_Entries(benchmark::State& state)
+{
+  const std::vector<uint8_t>& stream = benchStream();
+  static uint32_t timestamps[4096];
+  static uint16_t pulses[4096];
+  uint32_t sum = 0;
+
+  for (auto _ : state) {
+    LogDecoder decoder;
+    size_t pos = 0, used, count;
+    while ((count = decoder.entries(stream.data() + pos, stream.size() - pos, timestamps, pulses, 4096, used)) > 0 || used > 0) {
+      pos += used;
+      sum += pulses[0];
+    }
+  }
+  state.counters["MB/s"] = (double)stream.size() * state.iterations() / (state.elapsedNs() / 1e3);
+  state.counters["sum"] = sum;
+}
+BENCHMARK(BM_LogDecode_Entries);
+
+static void noop(void*) {}
+
+// The device task set: sensor drain, OTA, AP window, LED blink and log flush.
+// Each iteration sleeps as long as run() allows, like loop() does.
+static void BM_SchedulerRun(benchmark::State& state)
+{
+  Scheduler scheduler;
+  scheduler.every("sensor", SENSOR_DRAIN_MS, noop, nullptr);
+  scheduler.every("ota", 20, noop, nullptr);
+  scheduler.every("ap-window", 1000, noop, nullptr);
+  scheduler.every("led", 250, noop, nullptr);
+  scheduler.every("events", EVENT_POLL_MS, noop, nullptr);
+
+  uint64_t start = shim::nowMicros();
+  for (auto _ : state)
+    shim::advanceMicros(scheduler.run() * 1000ULL);
+
+  state.counters["ms/wakeup"] = (double)(shim::nowMicros() - start) / 1000 / state.iterations();
+}
+BENCHMARK(BM_SchedulerRun);
+
+// What instrumenting a hot path costs
+static Counter _benchCounter("bench_counter_total", "Benchmark counter");
+static Histogram _benchHistogram("bench_seconds", "Benchmark timer");
+
+static void BM_MetricTimer(benchmark::State& state)
+{
+  for (auto _ : state) {
+    MetricTimer timer(_benchHistogram);
+    _benchCounter.add();
+    shim::advanceMicros(3);
+  }
+}
+BENCHMARK(BM_MetricTimer);
+
+BENCHMARK_MAIN();
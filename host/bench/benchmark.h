@@ -0,0 +1,148 @@
+// Minimal subset of the Google Benchmark API (State, BENCHMARK, counters) so the
+// suite builds without external dependencies. Swap in <benchmark/benchmark.h>
+// unchanged when the real library is available.
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace benchmark {
+
+template <class T>
+inline void DoNotOptimize(T& value)
+{
+  asm volatile("" : "+r,m"(value) : : "memory");
+}
+
+inline void ClobberMemory()
+{
+  asm volatile("" : : : "memory");
+}
+
+class State
+{
+public:
+  // What `for (auto _ : state)` binds; a user-provided destructor keeps the
+  // compiler from calling `_` unused, as for any RAII guard
+  struct Value {
+    ~Value() {}
+  };
+
+  explicit State(uint64_t iterations) : _iterations(iterations), _elapsed(0), _running(false) {}
+
+  struct Iterator {
+    State* state;
+    uint64_t left;
+
+    inline bool operator!=(const Iterator&) const
+    {
+      if (left)
+        return true;
+      state->finish();
+      return false;
+    }
+    inline void operator++() { --left; }
+    inline Value operator*() const { return {}; }
+  };
+
+  inline Iterator begin()
+  {
+    start();
+    return Iterator{ this, _iterations };
+  }
+  inline Iterator end() { return Iterator{ this, 0 }; }
+
+  // Exclude setup work inside the loop from the measurement
+  inline void PauseTiming() { finish(); }
+  inline void ResumeTiming() { start(); }
+
+  inline uint64_t iterations() const { return _iterations; }
+  inline double elapsedNs() const { return _elapsed; }
+
+  std::map<std::string, double> counters;
+
+private:
+  inline void start()
+  {
+    _running = true;
+    _start = std::chrono::steady_clock::now();
+  }
+
+  inline void finish()
+  {
+    if (!_running)
+      return;
+    _running = false;
+    _elapsed += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - _start).count();
+  }
+
+  uint64_t _iterations;
+  double _elapsed;
+  bool _running;
+  std::chrono::steady_clock::time_point _start;
+};
+
+typedef void (*Function)(State&);
+
+struct Registration {
+  const char* name;
+  Function fn;
+};
+
+inline std::vector<Registration>& registry()
+{
+  static std::vector<Registration> benchmarks;
+  return benchmarks;
+}
+
+inline int Register(const char* name, Function fn)
+{
+  registry().push_back({ name, fn });
+  return 0;
+}
+
+// Grows the iteration count until a run takes at least 0.2 s, like Google Benchmark
+inline void RunSpecifiedBenchmarks(const char* filter)
+{
+  printf("%-32s %14s %14s  %s\n", "Benchmark", "Time", "Iterations", "Counters");
+
+  for (const Registration& reg : registry()) {
+    if (filter && !strstr(reg.name, filter))
+      continue;
+
+    uint64_t iterations = 1;
+    for (;;) {
+      State state(iterations);
+      reg.fn(state);
+
+      if (state.elapsedNs() >= 2e8 || iterations >= (1ULL << 30)) {
+        printf("%-32s %11.1f ns %14llu ", reg.name, state.elapsedNs() / iterations, (unsigned long long)iterations);
+        for (auto& counter : state.counters)
+          printf(" %s=%.6g", counter.first.c_str(), counter.second);
+        printf("\n");
+        break;
+      }
+
+      double scale = state.elapsedNs() > 0 ? 2.2e8 / state.elapsedNs() : 10;
+      iterations = (uint64_t)(iterations * (scale > 10 ? 10 : scale)) + 1;
+    }
+  }
+}
+
+}  // namespace benchmark
+
+#define BENCHMARK_CONCAT(a, b)  a##b
+#define BENCHMARK_NAME(a, b)    BENCHMARK_CONCAT(a, b)
+#define BENCHMARK(fn)           static int BENCHMARK_NAME(_benchmark_, __LINE__) = benchmark::Register(#fn, fn)
+
+#define BENCHMARK_MAIN()                                              \
+  int main(int argc, char** argv)                                     \
+  {                                                                   \
+    benchmark::RunSpecifiedBenchmarks(argc > 1 ? argv[1] : nullptr);  \
+    return 0;                                                         \
+  }
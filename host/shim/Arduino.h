@@ -0,0 +1,134 @@
+// Host build shim: the subset of the ESP8266 Arduino core used by elmer,
+// driven by a virtual clock and virtual pins (see shim.h).
+#pragma once
+
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <string>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH          1
+#define LOW           0
+
+#define INPUT         0x00
+#define INPUT_PULLUP  0x02
+#define OUTPUT        0x01
+
+#define RISING        0x01
+#define FALLING       0x02
+#define CHANGE        0x03
+
+// NodeMCU pin labels
+#define D0  16
+#define D1  5
+#define D2  4
+#define D3  0
+#define D4  2
+#define D5  14
+#define D6  12
+#define D7  13
+#define D8  15
+
+#define F_CPU         80000000L   // matches EspClass::getCycleCount()
+
+#define IRAM_ATTR
+#define ICACHE_RAM_ATTR
+#define PROGMEM
+#define PSTR(s)             (s)
+#define F(s)                (s)
+#define pgm_read_byte(addr)  (*(const uint8_t*)(addr))
+#define pgm_read_word(addr)  (*(const uint16_t*)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t*)(addr))
+#define memcpy_P            memcpy
+#define strlen_P            strlen
+#define strcmp_P            strcmp
+#define strncpy_P           strncpy
+#define snprintf_P          snprintf
+#define vsnprintf_P         vsnprintf
+
+#define digitalPinToInterrupt(pin)  (pin)
+
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t value);
+void analogWrite(uint8_t pin, int value);
+
+// GPIO input register: levels of GPIO0-15, one bit per pin (esp8266_peri.h)
+uint32_t gpioInputs();
+#define GPI  gpioInputs()
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+
+void noInterrupts();
+void interrupts();
+void attachInterruptArg(uint8_t pin, void (*handler)(void*), void* arg, int mode);
+void detachInterrupt(uint8_t pin);
+
+class Print
+{
+public:
+  virtual ~Print() {}
+
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size)
+  {
+    size_t n = 0;
+    while (n < size && write(buffer[n]))
+      n++;
+    return n;
+  }
+
+  inline size_t write(const char* str) { return write((const uint8_t*)str, strlen(str)); }
+  inline size_t print(const char* str) { return write(str); }
+
+  size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class Stream : public Print
+{
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+};
+
+class String
+{
+public:
+  String(const char* str = "") : _str(str ? str : "") {}
+
+  inline const char* c_str() const { return _str.c_str(); }
+  inline unsigned int length() const { return _str.size(); }
+  inline long toInt() const { return strtol(_str.c_str(), nullptr, 10); }
+
+  inline bool operator==(const char* str) const { return _str == str; }
+  inline bool operator!=(const char* str) const { return _str != str; }
+
+private:
+  std::string _str;
+};
+
+class EspClass
+{
+public:
+  String getSketchMD5();
+  uint32_t getCycleCount();
+
+  // 512 bytes addressed in 4-byte blocks, kept across shim "resets"
+  bool rtcUserMemoryRead(uint32_t offset, uint32_t* data, size_t size);
+  bool rtcUserMemoryWrite(uint32_t offset, uint32_t* data, size_t size);
+};
+
+extern EspClass ESP;
@@ -0,0 +1,101 @@
+// Host build shim: in-memory replacement for the ESP8266 fs::FS API
+#pragma once
+
+#include <Arduino.h>
+
+#include <memory>
+
+namespace fs {
+
+enum SeekMode { SeekSet = 0, SeekCur = 1, SeekEnd = 2 };
+
+struct FSInfo {
+  size_t totalBytes;
+  size_t usedBytes;
+  size_t blockSize;
+  size_t pageSize;
+  size_t maxOpenFiles;
+  size_t maxPathLength;
+};
+
+struct Node;
+
+class File : public Stream
+{
+public:
+  File() : _pos(0), _writable(false), _append(false) {}
+  File(std::shared_ptr<Node> node, bool writable, bool append);
+
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t read(uint8_t* buffer, size_t size);
+
+  bool seek(uint32_t pos, SeekMode mode);
+  inline bool seek(uint32_t pos) { return seek(pos, SeekSet); }
+  size_t position() const { return _pos; }
+  size_t size() const;
+  bool truncate(uint32_t size);
+
+  void flush();
+  void close();
+
+  const char* name() const;
+  inline operator bool() const { return (bool)_node; }
+
+private:
+  std::shared_ptr<Node> _node;
+  size_t _pos;
+  bool _writable;
+  bool _append;
+};
+
+class Dir
+{
+public:
+  Dir() : _index(-1) {}
+  Dir(const char* path) : _path(path ? path : ""), _index(-1) {}
+
+  bool next();
+  const char* fileName() const;
+  size_t fileSize() const;
+  File openFile(const char* mode);
+
+private:
+  const char* name() const;
+
+  const char* _path;
+  int _index;
+};
+
+class FS
+{
+public:
+  bool begin();
+  void end() {}
+  bool format();
+  bool info(FSInfo& info);
+
+  File open(const char* path, const char* mode);
+  Dir openDir(const char* path);
+  bool exists(const char* path);
+  bool remove(const char* path);
+  bool rename(const char* pathFrom, const char* pathTo);
+  bool mkdir(const char* path);
+  bool rmdir(const char* path);
+};
+
+}  // namespace fs
+
+using fs::Dir;
+using fs::File;
+using fs::FS;
+using fs::FSInfo;
+using fs::SeekMode;
+using fs::SeekSet;
+using fs::SeekCur;
+using fs::SeekEnd;
@@ -0,0 +1,363 @@
+#include <map>
+#include <string>
+#include <vector>
+
+#include "FS.h"
+#include "shim.h"
+
+namespace fs {
+
+struct Node {
+  std::string name;
+  std::vector<uint8_t> data;
+  size_t synced = 0;    // size at the last sync
+  bool dirty = false;
+};
+
+}  // namespace fs
+
+namespace {
+
+const size_t TOTAL_BYTES = 2 * 1024 * 1024;   // nodemcuv2 default LittleFS partition
+
+// A cost model of LittleFS as the ESP8266 core configures it; no LittleFS
+// code runs here, only its geometry and commit pattern are modelled
+const size_t FLASH_BLOCK = 8192;      // erase unit
+const size_t FLASH_PROG = 64;         // program unit, also the largest file kept inline in metadata
+const size_t FLASH_COMMIT = 40;       // metadata commit without inline data: tags, file struct, CRC
+const size_t FLASH_ENTRY = 48;        // a file's share of a compacted metadata block
+
+// Never destroyed: global objects like the sensor still flush from their destructors
+std::map<std::string, std::shared_ptr<fs::Node>>& _files = *new std::map<std::string, std::shared_ptr<fs::Node>>;
+shim::FsStats _stats;
+size_t _metadata;   // bytes used in the active block of the root metadata pair
+
+std::shared_ptr<fs::Node> lookup(const char* path)
+{
+  auto it = _files.find(path);
+  return it == _files.end() ? nullptr : it->second;
+}
+
+inline size_t roundUp(size_t size, size_t unit)
+{
+  return (size + unit - 1) / unit * unit;
+}
+
+// A commit appends to the active metadata block; a full block is compacted
+// into the other one of the pair, which costs an erase
+void commitMetadata(size_t inlineBytes)
+{
+  size_t len = roundUp(FLASH_COMMIT + inlineBytes, FLASH_PROG);
+
+  if (_metadata + len > FLASH_BLOCK) {
+    _metadata = roundUp(_files.size() * FLASH_ENTRY, FLASH_PROG);
+    _stats.programmed += _metadata;
+    _stats.erases++;
+  }
+
+  _metadata += len;
+  _stats.programmed += len;
+  _stats.commits++;
+}
+
+// What a sync of the file costs on NOR flash, roughly. Small files live
+// inline in the metadata commit. Larger ones are block lists that are never
+// programmed twice: appending after a sync copies the partly filled last
+// block into a fresh one before the new data, which is why many small
+// synced appends wear the flash far more than their size suggests.
+void syncNode(fs::Node& node)
+{
+  if (!node.dirty)
+    return;
+
+  size_t size = node.data.size();
+  node.dirty = false;
+
+  if (size <= FLASH_PROG) {
+    commitMetadata(size);
+    node.synced = size;
+    return;
+  }
+
+  size_t from = node.synced > FLASH_PROG && node.synced <= size ? node.synced : 0;
+  size_t bytes = from % FLASH_BLOCK + size - from;
+
+  _stats.programmed += roundUp(bytes, FLASH_PROG);
+  _stats.erases += (bytes + FLASH_BLOCK - 1) / FLASH_BLOCK;
+  commitMetadata(0);
+  node.synced = size;
+}
+
+}  // namespace
+
+fs::FS LittleFS;
+
+namespace shim {
+
+const FsStats& fsStats() { return _stats; }
+
+void resetFs()
+{
+  _files.clear();
+  _stats = FsStats();
+  _metadata = 0;
+}
+
+}  // namespace shim
+
+namespace fs {
+
+// File
+File::File(std::shared_ptr<Node> node, bool writable, bool append)
+    : _node(node), _pos(0), _writable(writable), _append(append)
+{
+  if (append)
+    _pos = node->data.size();
+}
+
+size_t File::write(uint8_t c)
+{
+  return write(&c, 1);
+}
+
+size_t File::write(const uint8_t* buffer, size_t size)
+{
+  if (!_node || !_writable)
+    return 0;
+
+  std::vector<uint8_t>& data = _node->data;
+  if (_append)
+    _pos = data.size();
+  if (_pos + size > data.size())
+    data.resize(_pos + size);
+
+  memcpy(data.data() + _pos, buffer, size);
+  _pos += size;
+  _node->dirty = true;
+  _stats.bytesWritten += size;
+  return size;
+}
+
+int File::available()
+{
+  return _node ? (int)(_node->data.size() - _pos) : 0;
+}
+
+int File::read()
+{
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+int File::peek()
+{
+  return available() > 0 ? _node->data[_pos] : -1;
+}
+
+size_t File::read(uint8_t* buffer, size_t size)
+{
+  if (!_node)
+    return 0;
+
+  size_t left = available();
+  if (size > left)
+    size = left;
+
+  memcpy(buffer, _node->data.data() + _pos, size);
+  _pos += size;
+  return size;
+}
+
+bool File::seek(uint32_t pos, SeekMode mode)
+{
+  if (!_node)
+    return false;
+
+  size_t target = pos;
+  if (mode == SeekCur)
+    target = _pos + pos;
+  else if (mode == SeekEnd)
+    target = _node->data.size() - pos;
+
+  if (target > _node->data.size())
+    return false;
+
+  _pos = target;
+  return true;
+}
+
+size_t File::size() const
+{
+  return _node ? _node->data.size() : 0;
+}
+
+bool File::truncate(uint32_t size)
+{
+  if (!_node || !_writable || size > _node->data.size())
+    return false;
+
+  _node->data.resize(size);
+  _node->dirty = true;
+  if (_pos > size)
+    _pos = size;
+  return true;
+}
+
+void File::flush()
+{
+  if (!_node || !_writable)
+    return;
+
+  _stats.flushes++;
+  syncNode(*_node);
+}
+
+void File::close()
+{
+  flush();
+  _node.reset();
+}
+
+const char* File::name() const
+{
+  if (!_node)
+    return "";
+
+  const char* slash = strrchr(_node->name.c_str(), '/');
+  return slash ? slash + 1 : _node->name.c_str();
+}
+
+// Dir iterates the files directly below a directory path
+bool Dir::next()
+{
+  size_t prefix = strlen(_path);
+
+  while (++_index < (int)_files.size()) {
+    auto it = _files.begin();
+    std::advance(it, _index);
+
+    const std::string& path = it->first;
+    if (path.compare(0, prefix, _path) == 0 && path.size() > prefix + 1 && path[prefix] == '/' &&
+        path.find('/', prefix + 1) == std::string::npos)
+      return true;
+  }
+  return false;
+}
+
+const char* Dir::name() const
+{
+  auto it = _files.begin();
+  std::advance(it, _index);
+  return it->first.c_str();
+}
+
+const char* Dir::fileName() const
+{
+  return name() + strlen(_path) + 1;
+}
+
+size_t Dir::fileSize() const
+{
+  auto it = _files.begin();
+  std::advance(it, _index);
+  return it->second->data.size();
+}
+
+File Dir::openFile(const char* mode)
+{
+  return LittleFS.open(name(), mode);
+}
+
+// FS
+bool FS::begin()
+{
+  return true;
+}
+
+bool FS::format()
+{
+  _files.clear();
+  return true;
+}
+
+bool FS::info(FSInfo& info)
+{
+  size_t used = 0;
+  for (auto& file : _files)
+    used += roundUp(file.second->data.size(), FLASH_BLOCK);
+
+  info.totalBytes = TOTAL_BYTES;
+  info.usedBytes = used;
+  info.blockSize = FLASH_BLOCK;
+  info.pageSize = 256;
+  info.maxOpenFiles = 5;
+  info.maxPathLength = 32;
+  return true;
+}
+
+File FS::open(const char* path, const char* mode)
+{
+  bool write = mode[0] == 'w' || mode[0] == 'a' || mode[1] == '+';
+  std::shared_ptr<Node> node = lookup(path);
+
+  if (!node) {
+    if (mode[0] == 'r')
+      return File();
+
+    node = std::make_shared<Node>();
+    node->name = path;
+    _files[path] = node;
+    commitMetadata(0);
+  } else if (mode[0] == 'w') {
+    node->data.clear();
+    node->synced = 0;
+    node->dirty = true;
+  }
+
+  _stats.opens++;
+  return File(node, write, mode[0] == 'a');
+}
+
+Dir FS::openDir(const char* path)
+{
+  return Dir(path);
+}
+
+bool FS::exists(const char* path)
+{
+  return (bool)lookup(path);
+}
+
+bool FS::remove(const char* path)
+{
+  if (_files.erase(path) == 0)
+    return false;
+
+  commitMetadata(0);
+  return true;
+}
+
+bool FS::rename(const char* pathFrom, const char* pathTo)
+{
+  std::shared_ptr<Node> node = lookup(pathFrom);
+  if (!node)
+    return false;
+
+  _files.erase(pathFrom);
+  node->name = pathTo;
+  _files[pathTo] = node;
+  commitMetadata(0);
+  return true;
+}
+
+bool FS::mkdir(const char*)
+{
+  return true;
+}
+
+bool FS::rmdir(const char*)
+{
+  return true;
+}
+
+}  // namespace fs
@@ -0,0 +1,146 @@
+#include "shim.h"
+
+namespace {
+
+struct Pin {
+  uint8_t mode;
+  int level;
+  int analog;
+  void (*handler)(void*);
+  void* arg;
+  int irqMode;
+};
+
+uint64_t _micros;
+time_t _epoch = 1735689600;  // 2025-01-01
+Pin _pins[17];
+uint32_t _rtcMemory[128];
+
+}  // namespace
+
+extern "C" time_t shim_time(void)
+{
+  return _epoch + (time_t)(_micros / 1000000);
+}
+
+namespace shim {
+
+void setMicros(uint64_t now) { _micros = now; }
+void advanceMicros(uint64_t delta) { _micros += delta; }
+uint64_t nowMicros() { return _micros; }
+void setEpoch(time_t epoch) { _epoch = epoch; }
+
+void setPin(uint8_t pin, int level)
+{
+  Pin& p = _pins[pin];
+  if (p.level == level)
+    return;
+
+  p.level = level;
+  if (!p.handler)
+    return;
+
+  if (p.irqMode == CHANGE || (p.irqMode == RISING && level) || (p.irqMode == FALLING && !level))
+    p.handler(p.arg);
+}
+
+int analogValue(uint8_t pin) { return _pins[pin].analog; }
+
+void powerLoss()
+{
+  uint32_t noise = 2463534242u;
+  for (uint32_t& block : _rtcMemory) {
+    noise ^= noise << 13;
+    noise ^= noise >> 17;
+    noise ^= noise << 5;
+    block = noise;
+  }
+}
+
+}  // namespace shim
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+  _pins[pin].mode = mode;
+  if (mode == INPUT_PULLUP)
+    _pins[pin].level = HIGH;
+}
+
+int digitalRead(uint8_t pin) { return _pins[pin].level; }
+void digitalWrite(uint8_t pin, uint8_t value) { _pins[pin].level = value; }
+void analogWrite(uint8_t pin, int value) { _pins[pin].analog = value; }
+
+uint32_t gpioInputs()
+{
+  uint32_t levels = 0;
+  for (uint8_t pin = 0; pin < 16; pin++)
+    levels |= (uint32_t)(_pins[pin].level != 0) << pin;
+  return levels;
+}
+
+unsigned long millis() { return (unsigned long)(_micros / 1000); }
+unsigned long micros() { return (unsigned long)_micros; }
+void delay(unsigned long ms) { _micros += ms * 1000ULL; }
+void yield() {}
+
+void noInterrupts() {}
+void interrupts() {}
+
+void attachInterruptArg(uint8_t pin, void (*handler)(void*), void* arg, int mode)
+{
+  _pins[pin].handler = handler;
+  _pins[pin].arg = arg;
+  _pins[pin].irqMode = mode;
+}
+
+void detachInterrupt(uint8_t pin)
+{
+  _pins[pin].handler = nullptr;
+}
+
+EspClass ESP;
+
+String EspClass::getSketchMD5()
+{
+  return String("5eb63bbbe01eeed093cb22bb8f5acdc3");
+}
+
+// 80 MHz core clock, derived from the virtual clock
+uint32_t EspClass::getCycleCount()
+{
+  return (uint32_t)(_micros * 80);
+}
+
+bool EspClass::rtcUserMemoryRead(uint32_t offset, uint32_t* data, size_t size)
+{
+  if (offset > 127 || size > (128 - offset) * 4)
+    return false;
+
+  memcpy(data, _rtcMemory + offset, size);
+  return true;
+}
+
+bool EspClass::rtcUserMemoryWrite(uint32_t offset, uint32_t* data, size_t size)
+{
+  if (offset > 127 || size > (128 - offset) * 4)
+    return false;
+
+  memcpy(_rtcMemory + offset, data, size);
+  return true;
+}
+
+size_t Print::printf(const char* format, ...)
+{
+  char buffer[256];
+  va_list args;
+
+  va_start(args, format);
+  int len = vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+
+  if (len < 0)
+    return 0;
+  if ((size_t)len >= sizeof(buffer))
+    len = sizeof(buffer) - 1;
+  return write((const uint8_t*)buffer, len);
+}
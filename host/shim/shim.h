@@ -0,0 +1,36 @@
+// Controls for the host shim: virtual clock, pins and file system statistics.
+#pragma once
+
+#include <Arduino.h>
+
+namespace shim {
+
+// Virtual clock; millis(), micros() and time() all derive from it
+void setMicros(uint64_t now);
+void advanceMicros(uint64_t delta);
+uint64_t nowMicros();
+void setEpoch(time_t epoch);   // wall time at virtual micros 0
+
+// Virtual pins; setPin() fires attached interrupts on matching edges
+void setPin(uint8_t pin, int level);
+int analogValue(uint8_t pin);
+
+// RTC user memory survives resets; a power loss leaves noise behind
+void powerLoss();
+
+// bytesWritten is what the firmware wrote. programmed, erases and commits
+// come from the shim's own cost model of LittleFS on NOR flash (see fs.cpp),
+// not from running LittleFS: compare them between changes, not with a device.
+struct FsStats {
+  uint64_t bytesWritten;
+  uint32_t flushes;
+  uint32_t opens;
+  uint64_t programmed;
+  uint32_t erases;
+  uint32_t commits;
+};
+
+const FsStats& fsStats();
+void resetFs();      // drop all files and statistics
+
+}  // namespace shim
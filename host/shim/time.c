@@ -0,0 +1,12 @@
+// Overrides libc time() so firmware code sees the virtual wall clock
+#include <time.h>
+
+extern time_t shim_time(void);
+
+time_t time(time_t* t)
+{
+  time_t now = shim_time();
+  if (t)
+    *t = now;
+  return now;
+}
@@ -0,0 +1,138 @@
+// Checks VerticalDebouncer against Debouncer, PromptDebouncer and
+// LockOutDebouncer on synthetic bounce traces:
+//
+//   debouncecheck [seconds] [seed]
+//
+// Sixteen pins, GPIO0-15, each get their own trace of presses with contact
+// bounce and short glitches. Every millisecond the per-pin debouncers update
+// from their pin and a vertical debouncer per mode from the GPI snapshot;
+// their fell/rose bits must agree on every tick. Exits 1 on the first mismatch.
+#include <debouncer.h>
+#include <shim.h>
+
+#define PINS         16
+#define INTERVAL_MS  15
+
+// xorshift32, so a seed reproduces a failing trace
+static uint32_t _seed = 2463534242u;
+
+static uint32_t random32()
+{
+  _seed ^= _seed << 13;
+  _seed ^= _seed >> 17;
+  _seed ^= _seed << 5;
+  return _seed;
+}
+
+static uint32_t randomRange(uint32_t low, uint32_t high)
+{
+  return low + random32() % (high - low + 1);
+}
+
+// A pin alternates between holding a level and bouncing into the other one;
+// some holds are glitches shorter than the debounce interval
+struct Trace {
+  int level;
+  uint32_t holdUntil;
+  uint32_t bounceUntil;
+
+  int next(uint32_t ms)
+  {
+    if (ms < bounceUntil)
+      return random32() & 1;
+
+    if (ms == bounceUntil && bounceUntil) {
+      level = !level;
+      holdUntil = ms + (random32() % 8 ? randomRange(INTERVAL_MS, 400) : randomRange(1, INTERVAL_MS));
+    }
+
+    if (ms >= holdUntil)
+      bounceUntil = ms + randomRange(0, 6);
+    return level;
+  }
+};
+
+template <typename T>
+struct PinDebouncers {
+  T pins[PINS] = { {0, INTERVAL_MS}, {1, INTERVAL_MS}, {2, INTERVAL_MS}, {3, INTERVAL_MS},
+                   {4, INTERVAL_MS}, {5, INTERVAL_MS}, {6, INTERVAL_MS}, {7, INTERVAL_MS},
+                   {8, INTERVAL_MS}, {9, INTERVAL_MS}, {10, INTERVAL_MS}, {11, INTERVAL_MS},
+                   {12, INTERVAL_MS}, {13, INTERVAL_MS}, {14, INTERVAL_MS}, {15, INTERVAL_MS} };
+
+  void begin()
+  {
+    for (T& pin : pins)
+      pin.begin(INPUT);
+  }
+
+  void update(uint32_t& fell, uint32_t& rose)
+  {
+    fell = rose = 0;
+    for (uint8_t i = 0; i < PINS; i++) {
+      pins[i].update();
+      fell |= (uint32_t)pins[i].fell() << i;
+      rose |= (uint32_t)pins[i].rose() << i;
+    }
+  }
+};
+
+static PinDebouncers<Debouncer> _stable;
+static PinDebouncers<PromptDebouncer> _prompt;
+static PinDebouncers<LockOutDebouncer> _lockOut;
+
+static VerticalDebouncer _vertical[] = {
+  { INTERVAL_MS, VerticalDebouncer::STABLE },
+  { INTERVAL_MS, VerticalDebouncer::PROMPT },
+  { INTERVAL_MS, VerticalDebouncer::LOCK_OUT },
+};
+
+static const char* const _modes[] = { "stable", "prompt", "lock-out" };
+
+int main(int argc, char** argv)
+{
+  uint32_t seconds = argc > 1 ? strtoul(argv[1], nullptr, 10) : 600;
+  if (argc > 2)
+    _seed = strtoul(argv[2], nullptr, 10) | 1;
+
+  Trace traces[PINS] = {};
+  uint32_t changes = 0;
+
+  // Start past 0 so the lock-out debouncers are not locked out at begin()
+  shim::setMicros(1000000);
+  for (uint8_t i = 0; i < PINS; i++) {
+    traces[i].level = HIGH;
+    traces[i].holdUntil = randomRange(0, 400);
+    shim::setPin(i, HIGH);
+  }
+
+  _stable.begin();
+  _prompt.begin();
+  _lockOut.begin();
+  for (VerticalDebouncer& vertical : _vertical)
+    vertical.begin(GPI);
+
+  for (uint32_t ms = 1; ms <= seconds * 1000; ms++) {
+    shim::advanceMicros(1000);
+    for (uint8_t i = 0; i < PINS; i++)
+      shim::setPin(i, traces[i].next(ms));
+
+    uint32_t inputs = GPI;
+    uint32_t fell[3], rose[3];
+    _stable.update(fell[0], rose[0]);
+    _prompt.update(fell[1], rose[1]);
+    _lockOut.update(fell[2], rose[2]);
+
+    for (uint8_t mode = 0; mode < 3; mode++) {
+      _vertical[mode].update(inputs);
+      if (_vertical[mode].fell() != fell[mode] || _vertical[mode].rose() != rose[mode]) {
+        fprintf(stderr, "%s: mismatch at %u ms: fell %04x/%04x rose %04x/%04x\n", _modes[mode], ms,
+                _vertical[mode].fell(), fell[mode], _vertical[mode].rose(), rose[mode]);
+        return 1;
+      }
+      changes += __builtin_popcount(fell[mode] | rose[mode]);
+    }
+  }
+
+  printf("%u s of %u bouncing inputs, %u debounced changes: all modes match\n", seconds, PINS, changes);
+  return 0;
+}
@@ -0,0 +1,345 @@
+// Decodes sensor log v2 files (/sensor.bin, segment files) to CSV or InfluxDB
+// line protocol:
+//
+//   elmerdump [-f csv|influx] [-c|-p] [-m measurement] [-t tag=value,...] <sensor.bin>...
+//
+// -c adds the channel of each interval, as a CSV column or a `channel` tag;
+// it is needed for logs of a MultiSensor, whose records are otherwise skipped.
+// -p reads pulse captures (/capture.bin) instead: a line per pulse with its
+// time, the interval since the previous pulse in us and the power it means.
+// Their influx timestamps are in nanoseconds (precision=ns).
+//
+// Files are mapped rather than read and decoded in batches with
+// LogDecoder::entries(), the same codec the firmware writes with. Influx
+// timestamps are in seconds; write them with precision=s.
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <logcodec.h>
+
+#define BATCH_SIZE   4096          // entries decoded per call
+#define OUTPUT_SIZE  (1 << 20)     // bytes formatted per write
+#define LINE_MAX_LEN 256           // worst-case line, including the influx prefix
+
+enum Format { CSV, INFLUX };
+
+static char _output[OUTPUT_SIZE];
+static size_t _outputLen;
+
+static char _prefix[LINE_MAX_LEN - 32];   // influx "measurement,tags pulses="
+static size_t _prefixLen;
+static size_t _tagsLen;                   // influx prefix up to the space, for the channel tag
+static bool _channels;
+static bool _captures;
+
+static const char _digitPairs[] =
+  "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+  "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
+
+static inline char* formatUInt(char* out, uint32_t value)
+{
+  char digits[10];
+  char* end = digits + sizeof(digits);
+  char* p = end;
+
+  while (value >= 100) {
+    p -= 2;
+    memcpy(p, _digitPairs + (value % 100) * 2, 2);
+    value /= 100;
+  }
+  if (value >= 10) {
+    p -= 2;
+    memcpy(p, _digitPairs + value * 2, 2);
+  } else
+    *--p = '0' + value;
+
+  memcpy(out, p, end - p);
+  return out + (end - p);
+}
+
+static void flushOutput()
+{
+  if (_outputLen && fwrite(_output, 1, _outputLen, stdout) != _outputLen) {
+    perror("stdout");
+    exit(1);
+  }
+  _outputLen = 0;
+}
+
+// Timestamps mostly grow by a few intervals, so the text of the previous one
+// is advanced in place instead of formatted from scratch
+class Timestamp
+{
+public:
+  Timestamp() : _value(0), _len(1) { _text[0] = '0'; }
+
+  inline char* format(char* out, uint32_t value)
+  {
+    if (value < _value || value - _value >= 1000000 || !advance(value - _value))
+      _len = formatUInt(_text, value) - _text;
+
+    _value = value;
+    memcpy(out, _text, 10);   // fixed-size copy; only _len bytes count
+    return out + _len;
+  }
+
+private:
+  // Decimal addition on the text; fails when the number would grow a digit
+  inline bool advance(uint32_t delta)
+  {
+    int carry = 0;
+
+    for (int i = _len - 1; delta || carry; i--) {
+      if (i < 0)
+        return false;
+
+      int digit = _text[i] - '0' + delta % 10 + carry;
+      delta /= 10;
+      carry = digit >= 10;
+      _text[i] = '0' + digit - carry * 10;
+    }
+    return true;
+  }
+
+  uint32_t _value;
+  size_t _len;
+  char _text[16];
+};
+
+static Timestamp _timestamp;
+
+// Pulse counts are small: their text comes from a table
+#define PULSE_TABLE 1024
+
+static uint32_t _pulseText[PULSE_TABLE];   // up to 3 digits, length in the top byte
+
+static void initPulseText()
+{
+  for (uint32_t value = 0; value < PULSE_TABLE; value++) {
+    char text[10];
+    size_t len = formatUInt(text, value) - text;
+    if (len > 3)
+      continue;
+
+    memcpy(&_pulseText[value], text, len);
+    _pulseText[value] |= (uint32_t)len << 24;
+  }
+}
+
+static inline char* formatPulses(char* out, uint16_t value)
+{
+  if (value >= PULSE_TABLE || !_pulseText[value])
+    return formatUInt(out, value);
+
+  memcpy(out, &_pulseText[value], 4);
+  return out + (_pulseText[value] >> 24);
+}
+
+static void emit(Format format, const uint32_t* timestamps, const uint16_t* pulses, const uint8_t* channels,
+                 size_t count)
+{
+  for (size_t i = 0; i < count; i++) {
+    if (OUTPUT_SIZE - _outputLen < LINE_MAX_LEN)
+      flushOutput();
+
+    char* out = _output + _outputLen;
+    if (format == CSV) {
+      out = _timestamp.format(out, timestamps[i]);
+      *out++ = ',';
+      out = formatPulses(out, pulses[i]);
+      if (_channels) {
+        *out++ = ',';
+        out = formatPulses(out, channels[i]);
+      }
+    } else if (_channels) {
+      memcpy(out, _prefix, _tagsLen);
+      memcpy(out + _tagsLen, ",channel=", 9);
+      out = formatPulses(out + _tagsLen + 9, channels[i]);
+      memcpy(out, _prefix + _tagsLen, _prefixLen - _tagsLen);
+      out = formatPulses(out + _prefixLen - _tagsLen, pulses[i]);
+      *out++ = 'i';
+      *out++ = ' ';
+      out = _timestamp.format(out, timestamps[i]);
+    } else {
+      memcpy(out, _prefix, _prefixLen);
+      out = formatPulses(out + _prefixLen, pulses[i]);
+      *out++ = 'i';
+      *out++ = ' ';
+      out = _timestamp.format(out, timestamps[i]);
+    }
+    *out++ = '\n';
+    _outputLen = out - _output;
+  }
+}
+
+static void dumpCapture(const char* path, const uint8_t* data, size_t size, Format format)
+{
+  CaptureHeader header;
+  memcpy(&header, data, sizeof(header));
+
+  uint64_t micros = (uint64_t)header.startTime * 1000000;
+  double joules = 3.6e6 / (header.impulsesPerKWh ? header.impulsesPerKWh : 1);
+  size_t pos = sizeof(header), used;
+  uint32_t delta;
+  bool first = true;
+
+  while ((used = logcodec::getVarint(data + pos, size - pos, delta)) > 0) {
+    pos += used;
+    micros += delta;
+
+    // The first delta runs from the start of the capture, not from a pulse
+    if (first) {
+      first = false;
+      continue;
+    }
+
+    if (OUTPUT_SIZE - _outputLen < LINE_MAX_LEN)
+      flushOutput();
+
+    double watts = joules * 1e6 / delta;
+    if (format == CSV)
+      _outputLen += snprintf(_output + _outputLen, LINE_MAX_LEN, "%llu.%06llu,%lu,%.1f\n",
+                             (unsigned long long)(micros / 1000000), (unsigned long long)(micros % 1000000),
+                             (unsigned long)delta, watts);
+    else
+      _outputLen += snprintf(_output + _outputLen, LINE_MAX_LEN, "%.*sinterval=%lui,watts=%.1f %llu000\n",
+                             (int)(_tagsLen + 1), _prefix, (unsigned long)delta, watts, (unsigned long long)micros);
+  }
+
+  if (pos < size)
+    fprintf(stderr, "%s: %zu trailing bytes of a truncated record\n", path, size - pos);
+}
+
+static bool dump(const char* path, Format format)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    perror(path);
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    perror(path);
+    close(fd);
+    return false;
+  }
+
+  size_t size = st.st_size;
+  if (size == 0) {
+    close(fd);
+    return true;
+  }
+
+  const uint8_t* data = (const uint8_t*)mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    perror(path);
+    return false;
+  }
+  madvise((void*)data, size, MADV_SEQUENTIAL);
+
+  if (_captures) {
+    bool ok = logcodec::isCapture(data, size);
+    if (ok)
+      dumpCapture(path, data, size, format);
+    else
+      fprintf(stderr, "%s: not a pulse capture\n", path);
+
+    munmap((void*)data, size);
+    return ok;
+  }
+
+  static uint32_t timestamps[BATCH_SIZE];
+  static uint16_t pulses[BATCH_SIZE];
+  static uint8_t channels[BATCH_SIZE];
+  LogDecoder decoder;
+  size_t pos = 0, used, count;
+
+  while ((count = decoder.entries(data + pos, size - pos, timestamps, pulses, BATCH_SIZE, used,
+                                  _channels ? channels : nullptr)) > 0 || used > 0) {
+    emit(format, timestamps, pulses, channels, count);
+    pos += used;
+  }
+
+  munmap((void*)data, size);
+
+  if (decoder.invalid())
+    fprintf(stderr, "%s: %u invalid bytes skipped\n", path, decoder.invalid());
+  if (pos < size)
+    fprintf(stderr, "%s: %zu trailing bytes of a truncated record\n", path, size - pos);
+  return true;
+}
+
+static void usage()
+{
+  fprintf(stderr, "Usage: elmerdump [-f csv|influx] [-c|-p] [-m measurement] [-t tag=value,...] <sensor.bin>...\n");
+  exit(1);
+}
+
+int main(int argc, char** argv)
+{
+  const char* measurement = "elmer";
+  const char* tags = nullptr;
+  Format format = CSV;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "cf:m:pt:")) != -1) {
+    switch (opt) {
+      case 'c':
+        _channels = true;
+        break;
+      case 'f':
+        if (!strcmp(optarg, "csv"))
+          format = CSV;
+        else if (!strcmp(optarg, "influx"))
+          format = INFLUX;
+        else
+          usage();
+        break;
+      case 'm':
+        measurement = optarg;
+        break;
+      case 'p':
+        _captures = true;
+        break;
+      case 't':
+        tags = optarg;
+        break;
+      default:
+        usage();
+    }
+  }
+
+  if (optind == argc)
+    usage();
+
+  int len = snprintf(_prefix, sizeof(_prefix), "%s%s%s pulses=", measurement, tags ? "," : "", tags ? tags : "");
+  if (len < 0 || (size_t)len >= sizeof(_prefix)) {
+    fprintf(stderr, "elmerdump: measurement and tags too long\n");
+    return 1;
+  }
+  _prefixLen = len;
+  _tagsLen = len - strlen(" pulses=");
+  initPulseText();
+
+  if (format == CSV) {
+    const char* header = _captures ? "timestamp,interval,watts\n" :
+                         _channels ? "timestamp,count,channel\n" : "timestamp,count\n";
+    _outputLen = strlen(header);
+    memcpy(_output, header, _outputLen);
+  }
+
+  bool ok = true;
+  for (int i = optind; i < argc; i++)
+    ok &= dump(argv[i], format);
+
+  flushOutput();
+  return ok ? 0 : 1;
+}
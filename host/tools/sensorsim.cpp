@@ -0,0 +1,539 @@
+// Replays a meter into Sensor faster than real time and checks the log it
+// writes against the pulses that went in:
+//
+//   sensorsim [-d days] [-s seed] [-i intervalSec] [-b bufferSize] [-R resetDays] [-m pulses/s] [-r capture.bin]
+//
+// The meter is synthetic, a household load with appliances, bursts of
+// several kW and a holiday long enough to wrap the log offsets, or replays
+// the pulse times of a capture (Sensor::startCapture) in a loop. Every pulse
+// and the occasional glitch shorter than the debounce interval get contact
+// bounce. The pin drives Sensor in INTERRUPT mode on the virtual clock; the
+// sensor task runs every SENSOR_DRAIN_MS while the pin settles and otherwise
+// only on interval boundaries, which it would sleep through on the device.
+// Now and then it oversleeps a few boundaries, as behind a busy loop().
+// Sensor is set up as src.ino does it, warm restarts included, and the
+// device resets between pulses every -R days on average (0: never). One
+// reset in four is a power loss, which leaves noise in RTC memory: the
+// intervals not committed by then are lost and the hours they belong to
+// are not checked.
+//
+// Once a simulated day the log is fetched from where the last fetch ended,
+// like a client syncing incrementally, and decoded. A pulse belongs to the
+// interval of the task run that confirms it, an interval boundary counting
+// to the interval it closes. The hourly rollup must match the fetched log.
+// Exits 1 if any interval or rolled-up hour differs, the log has
+// undecodable bytes, edges were lost, the log and rollups outgrew
+// SEGMENT_BUDGET, or the replay ran slower than -m simulated pulses per second.
+//
+// On the host millis() does not wrap after 49 days as on the device, since
+// unsigned long has 64 bits; micros() wraps wherever the firmware keeps it
+// in 32 bits.
+#include <eventlog.h>
+#include <LittleFS.h>
+#include <logcodec.h>
+#include <scheduler.h>
+#include <segmentlog.h>
+#include <sensor.h>
+#include <shim.h>
+#include <storage.h>
+
+#include <chrono>
+#include <new>
+#include <unistd.h>
+#include <vector>
+
+#define SENSOR_PIN    D6
+#define EPOCH         1735689600UL                    // 2025-01-01, on the grid of every interval that divides a day
+#define TICK_US       (SENSOR_DRAIN_MS * 1000ULL)
+#define DEBOUNCE_US   (SENSOR_DEBOUNCE_MS * 1000ULL)
+#define DAY_US        (86400 * 1000000ULL)
+
+#define HOLD_MIN_MS   30     // meters keep an S0 pulse low at least this long
+#define HOLD_MAX_MS   90
+#define GAP_MIN_MS    40     // high before the next pulse, so the rise is confirmed
+#define PERIOD_MIN_MS (HOLD_MIN_MS + GAP_MIN_MS + 10)
+
+#define HOLIDAY_DAY   30     // days without load, if the run is long enough
+#define HOLIDAY_DAYS  24     // over UINT16_MAX intervals of 30 s
+
+// xorshift32, so a seed reproduces a failing run
+static uint32_t _seed = 2463534242u;
+
+static uint32_t random32()
+{
+  _seed ^= _seed << 13;
+  _seed ^= _seed >> 17;
+  _seed ^= _seed << 5;
+  return _seed;
+}
+
+static uint32_t randomRange(uint32_t low, uint32_t high)
+{
+  return low + random32() % (high - low + 1);
+}
+
+static Sensor* _sensor;
+static uint32_t _intervalSec;
+static size_t _bufferSize;
+static uint64_t _intervalUs;
+static uint32_t _days;
+
+static uint64_t _tick;          // next run of the sensor task
+static uint64_t _activeUntil;   // the task runs every TICK_US until then
+
+static std::vector<uint16_t> _truth;    // pulses by interval
+static std::vector<uint16_t> _logged;
+static uint32_t _pulses;
+static uint32_t _glitches;
+
+// Resets
+static uint64_t _resetUs;       // mean time between them, 0 for none
+static uint64_t _nextReset;
+static uint32_t _resets;
+static uint32_t _powerLosses;
+static uint32_t _forfeited;     // pulses a power loss took along
+static uint32_t _edgeOverflows; // of the sensors before the last reset
+static std::vector<bool> _unchecked;   // hours a power loss cut into
+
+// Log fetching
+static LogPosition _pos;
+static LogDecoder _decoder;
+static uint8_t _input[512];
+static size_t _inputUsed;
+static uint32_t _markers;
+static uint32_t _invalid;
+static uint32_t _strays;        // entries outside the simulated intervals
+static uint32_t _peakBytes;     // most the log and rollups took on flash
+
+// Load profile: a base load, appliances that come and go, and rare bursts
+static uint64_t _loadUntil;
+static uint32_t _loadWatts;
+
+// Capture replay
+static std::vector<uint32_t> _deltas;
+static size_t _next;
+
+static uint32_t dirSize(const char* path)
+{
+  Dir dir = LittleFS.openDir(path);
+  uint32_t size = 0;
+
+  while (dir.next())
+    size += dir.fileSize();
+  return size;
+}
+
+static void fetch()
+{
+  uint32_t used = dirSize(_sensorlog_dir) + dirSize("/rollup");
+  if (used > _peakBytes)
+    _peakBytes = used;
+
+  LogPosition end = _sensor->segments().end();
+  SegmentReader reader(_sensor->segments(), _pos, end, false);
+  LogRecord record;
+  size_t n;
+
+  while ((n = reader.read(_input + _inputUsed, sizeof(_input) - _inputUsed)) > 0) {
+    size_t pos = 0, len;
+
+    _inputUsed += n;
+    while ((len = _decoder.next(_input + pos, _inputUsed - pos, record)) > 0) {
+      pos += len;
+
+      if (record.type == LogRecord::MARKER) {
+        _markers++;
+      } else if (record.type == LogRecord::INVALID) {
+        _invalid += len;
+      } else if (record.type == LogRecord::ENTRY) {
+        // An entry is stamped with the end of its interval
+        uint64_t interval = (uint64_t)(record.timestamp - EPOCH) * 1000000 / _intervalUs;
+        if (record.timestamp > EPOCH && interval >= 1 && interval <= _logged.size())
+          _logged[interval - 1] += record.pulses;
+        else
+          _strays++;
+      }
+    }
+
+    memmove(_input, _input + pos, _inputUsed - pos);
+    _inputUsed -= pos;
+  }
+
+  _pos = end;
+}
+
+// Every full hour must hold the intervals the log holds, empty ones included;
+// returns the hours that differ
+static uint32_t checkRollups(uint32_t& hours)
+{
+  File file = LittleFS.open(_rollup_hour_path, "r");
+  uint32_t perHour = 3600 * 1000000ULL / _intervalUs, differ = 0;
+  RollupRecord record;
+
+  hours = 0;
+  while (file && file.read((uint8_t*)&record, sizeof(record)) == sizeof(record)) {
+    size_t hour = (record.start - EPOCH) / 3600, first = hour * perHour;
+    uint32_t sum = 0;
+
+    hours++;
+    if (hour < _unchecked.size() && _unchecked[hour])
+      continue;
+    for (size_t i = first; i < first + perHour && i < _logged.size(); i++)
+      sum += _logged[i];
+
+    if (record.count == perHour && record.sum == sum)
+      continue;
+
+    if (differ++ < 5)
+      fprintf(stderr, "hour %lu: %u pulses in %u intervals, log has %u in %u\n", (unsigned long)record.start,
+              record.sum, record.count, sum, perHour);
+  }
+
+  return differ;
+}
+
+static void runTask(uint64_t at)
+{
+  shim::setMicros(at);
+  _sensor->update(time(nullptr));
+  _events.update();
+
+  if (at % DAY_US == 0)
+    fetch();
+}
+
+// First task run after `at`
+static uint64_t nextTick(uint64_t at)
+{
+  uint64_t tick = at / TICK_US * TICK_US + TICK_US;
+  if (tick <= _activeUntil)
+    return tick;
+
+  // Only past an interval without pulses, which would otherwise close late
+  tick = at / _intervalUs * _intervalUs + _intervalUs;
+  if (random32() % 64 == 0 && at / _intervalUs < _truth.size() && !_truth[at / _intervalUs])
+    tick += randomRange(1, 3) * _intervalUs;
+  return tick;
+}
+
+// The task runs first when it is due at the same microsecond
+static void edge(uint64_t at, int level)
+{
+  while (_tick <= at) {
+    runTask(_tick);
+    _tick = nextTick(_tick);
+  }
+
+  shim::setMicros(at);
+  shim::setPin(SENSOR_PIN, level);
+
+  _activeUntil = at + DEBOUNCE_US + TICK_US;
+  _tick = nextTick(at);
+}
+
+// A level change with 0-5 bounces into the old level first; returns the last edge
+static uint64_t bounce(uint64_t at, int level)
+{
+  for (uint32_t n = randomRange(0, 5); n; n--) {
+    edge(at, level);
+    at += randomRange(50, 600);
+    edge(at, !level);
+    at += randomRange(50, 600);
+  }
+
+  edge(at, level);
+  return at;
+}
+
+// One pulse, held low for holdMs; the task run that confirms it decides its interval
+static void pulse(uint64_t at, uint32_t holdMs)
+{
+  uint64_t low = bounce(at, LOW);
+  uint64_t confirmed = (low + DEBOUNCE_US + TICK_US - 1) / TICK_US * TICK_US;
+  uint64_t interval = (confirmed - 1) / _intervalUs;
+
+  if (interval < _truth.size())
+    _truth[interval]++;
+  _pulses++;
+
+  bounce(low + holdMs * 1000ULL, HIGH);
+}
+
+// Low for less than the debounce interval, bounce included
+static void glitch(uint64_t at)
+{
+  edge(at, LOW);
+  edge(at + randomRange(100, DEBOUNCE_US - 3000), HIGH);
+  _glitches++;
+}
+
+// Sensor as src.ino sets it up
+static void startSensor()
+{
+  _sensor = new Sensor(SENSOR_PIN, _intervalSec, Sensor::INTERRUPT, _bufferSize);
+  _sensor->setWarmRestart(true);
+  _sensor->begin(INPUT_PULLUP);
+}
+
+// A power loss takes the buffered entries and the open interval along: the
+// intervals after the last one the committed log holds no longer count, and
+// neither do the rollups of their hours
+static void forfeit(uint64_t at)
+{
+  size_t last = _logged.size(), current = at / _intervalUs;
+  while (last > 0 && !_logged[last - 1])
+    last--;
+
+  for (size_t i = last; i <= current && i < _truth.size(); i++) {
+    _forfeited += _truth[i];
+    _truth[i] = 0;
+  }
+
+  uint64_t hourUs = 3600000000ULL;
+  for (uint64_t hour = last * _intervalUs / hourUs; hour <= at / hourUs && hour < _unchecked.size(); hour++)
+    _unchecked[hour] = true;
+}
+
+// A reset runs no destructors and starts RAM over: the globals the sensor
+// relies on are constructed again in place and the old Sensor is left as it
+// was, so only RTC memory and committed files carry over. The virtual clock
+// goes on, as if the clock were set again at once.
+static void restart(uint64_t at, bool powerLoss)
+{
+  while (_tick <= at) {
+    runTask(_tick);
+    _tick = nextTick(_tick);
+  }
+
+  shim::setMicros(at);
+  fetch();
+  _edgeOverflows += _sensor->edgeOverflows();
+
+  if (powerLoss) {
+    shim::powerLoss();
+    forfeit(at);
+    _powerLosses++;
+  } else {
+    _resets++;
+  }
+
+  new (&_scheduler) Scheduler();
+  new (&_storage) Storage();
+  new (&_events) EventLog();
+  _events.begin(EventLog::BINARY);
+  startSensor();
+}
+
+static uint32_t watts(uint64_t at)
+{
+  uint32_t hour = at / 3600000000ULL % 24;
+
+  if (at >= _loadUntil) {
+    uint32_t dice = random32() % 1000;
+    _loadUntil = at + 600000000ULL;
+    _loadWatts = 0;
+
+    if (dice < 5) {
+      _loadUntil = at + randomRange(60, 300) * 1000000ULL;
+      _loadWatts = randomRange(8000, 12000);
+    } else if (dice < 200) {
+      _loadUntil = at + randomRange(120, 1800) * 1000000ULL;
+      _loadWatts = randomRange(1000, 3000);
+    }
+  }
+
+  return (hour >= 18 && hour < 22 ? 250 : 150) + _loadWatts;
+}
+
+// Microseconds from the pulse at `at` to the next one
+static uint64_t period(uint64_t at)
+{
+  uint64_t us;
+
+  if (!_deltas.empty()) {
+    us = _deltas[_next++];
+    _next %= _deltas.size();
+  } else {
+    uint64_t holiday = HOLIDAY_DAY * DAY_US;
+    if (_days >= HOLIDAY_DAY + HOLIDAY_DAYS + 7 && at >= holiday && at < holiday + HOLIDAY_DAYS * DAY_US)
+      return holiday + HOLIDAY_DAYS * DAY_US - at;
+
+    us = 3600000000000ULL / ((uint64_t)SENSOR_IMPULSES_KWH * watts(at));
+  }
+
+  return us < PERIOD_MIN_MS * 1000ULL ? PERIOD_MIN_MS * 1000ULL : us;
+}
+
+static bool loadCapture(const char* path)
+{
+  FILE* file = fopen(path, "rb");
+  if (!file) {
+    perror(path);
+    return false;
+  }
+
+  std::vector<uint8_t> data;
+  uint8_t buffer[4096];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    data.insert(data.end(), buffer, buffer + n);
+  fclose(file);
+
+  if (!logcodec::isCapture(data.data(), data.size())) {
+    fprintf(stderr, "%s: not a pulse capture\n", path);
+    return false;
+  }
+
+  uint32_t delta;
+  for (size_t pos = sizeof(CaptureHeader); pos < data.size(); pos += n) {
+    n = logcodec::getVarint(data.data() + pos, data.size() - pos, delta);
+    if (!n)
+      break;
+    if (delta)
+      _deltas.push_back(delta);
+  }
+
+  if (_deltas.empty()) {
+    fprintf(stderr, "%s: no pulses\n", path);
+    return false;
+  }
+  return true;
+}
+
+static void usage()
+{
+  fprintf(stderr, "usage: sensorsim [-d days] [-s seed] [-i intervalSec] [-b bufferSize] [-R resetDays] [-m pulses/s] [-r capture.bin]\n");
+  exit(2);
+}
+
+int main(int argc, char** argv)
+{
+  double resetDays = 7;
+  double minRate = 0;
+  int opt;
+
+  _days = 365;
+  _intervalSec = 30;
+  _bufferSize = SENSOR_RTC_DATA;
+  while ((opt = getopt(argc, argv, "b:d:i:m:r:R:s:")) != -1) {
+    switch (opt) {
+      case 'b':
+        _bufferSize = strtoul(optarg, nullptr, 10);
+        break;
+      case 'd':
+        _days = strtoul(optarg, nullptr, 10);
+        break;
+      case 'i':
+        _intervalSec = strtoul(optarg, nullptr, 10);
+        break;
+      case 'm':
+        minRate = strtod(optarg, nullptr);
+        break;
+      case 'r':
+        if (!loadCapture(optarg))
+          return 2;
+        break;
+      case 'R':
+        resetDays = strtod(optarg, nullptr);
+        break;
+      case 's':
+        _seed = strtoul(optarg, nullptr, 10) | 1;
+        break;
+      default:
+        usage();
+    }
+  }
+
+  if (_days == 0 || _intervalSec == 0 || 86400 % _intervalSec || _bufferSize < 2 * LOG_MAX_RECORD || resetDays < 0)
+    usage();
+
+  uint32_t seed = _seed;
+  uint64_t endUs = _days * DAY_US;
+  _intervalUs = _intervalSec * 1000000ULL;
+  _truth.assign(endUs / _intervalUs, 0);
+  _logged.assign(_truth.size(), 0);
+  _unchecked.assign(_days * 24, false);
+  _resetUs = resetDays * DAY_US;
+
+  shim::resetFs();
+  shim::setEpoch(EPOCH);
+  shim::setMicros(0);
+  shim::setPin(SENSOR_PIN, HIGH);
+  LittleFS.begin();
+  _events.begin(EventLog::BINARY);
+
+  startSensor();
+  _pos = { _sensor->segments().first(), 0 };
+  _nextReset = _resetUs ? randomRange(1, 2 * _resetUs / 1000000) * 1000000ULL : UINT64_MAX;
+
+  auto started = std::chrono::steady_clock::now();
+  runTask(0);
+  _tick = nextTick(0);
+
+  // Pulses stop an hour before the end, so every buffer is written by then
+  uint64_t at = 1000000;
+  while (at < endUs - 3600000000ULL) {
+    uint64_t next = at + period(at);
+    uint32_t holdMs = (next - at) / 1000 - GAP_MIN_MS - 10;
+
+    pulse(at, randomRange(HOLD_MIN_MS, holdMs < HOLD_MAX_MS ? holdMs : HOLD_MAX_MS));
+    if (next - at > 1000000 && random32() % 16 == 0)
+      glitch(at + (next - at) / 2);
+
+    // Just before the next pulse, when the last one has long been confirmed
+    if (at >= _nextReset) {
+      restart(next - 5000, random32() % 4 == 0);
+      _nextReset = next + randomRange(1, 2 * _resetUs / 1000000) * 1000000ULL;
+    }
+    at = next;
+  }
+
+  while (_tick <= endUs) {
+    runTask(_tick);
+    _tick = nextTick(_tick);
+  }
+  _storage.sync();
+  fetch();
+  _edgeOverflows += _sensor->edgeOverflows();
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+  double rate = _pulses / seconds;
+
+  uint32_t hours, hoursDiffer = checkRollups(hours);
+  uint32_t lost = 0, extra = 0, differ = 0, gap = 0, longestGap = 0;
+  for (size_t i = 0; i < _truth.size(); i++) {
+    gap = _truth[i] ? 0 : gap + 1;
+    if (gap > longestGap)
+      longestGap = gap;
+
+    if (_truth[i] == _logged[i])
+      continue;
+
+    if (differ++ < 5)
+      fprintf(stderr, "interval %lu (%lu): %u pulses, %u logged\n", (unsigned long)i,
+              (unsigned long)(EPOCH + i * _intervalSec), _truth[i], _logged[i]);
+    if (_truth[i] > _logged[i])
+      lost += _truth[i] - _logged[i];
+    else
+      extra += _logged[i] - _truth[i];
+  }
+
+  const shim::FsStats& stats = shim::fsStats();
+  printf("%u days at %u s intervals, seed %u: %u pulses, %u glitches\n", _days, _intervalSec, seed, _pulses, _glitches);
+  printf("  replay:  %.2f s, %.0f pulses/s, %.0fx real time\n", seconds, rate, endUs / 1e6 / seconds);
+  printf("  log:     %u markers, %u invalid bytes, %u stray entries, %u edge overflows, longest gap %u intervals%s\n",
+         _markers, _invalid, _strays, _edgeOverflows, longestGap, longestGap >= UINT16_MAX ? " (offsets wrapped)" : "");
+  printf("  flash:   %.1f KB/day written; modelled %.1f KB/day programmed, %.1f erases/day, %.1f commits/day; "
+         "peak %u of %u KB\n", stats.bytesWritten / 1024.0 / _days, stats.programmed / 1024.0 / _days,
+         (double)stats.erases / _days, (double)stats.commits / _days, _peakBytes / 1024, SEGMENT_BUDGET / 1024);
+  printf("  resets:  %u warm, %u power losses taking %u pulses along\n", _resets, _powerLosses, _forfeited);
+  printf("  check:   %u intervals differ, %u pulses lost, %u extra; %u of %u rolled-up hours differ\n",
+         differ, lost, extra, hoursDiffer, hours);
+
+  if (minRate && rate < minRate) {
+    fprintf(stderr, "sensorsim: %.0f pulses/s, below %.0f\n", rate, minRate);
+    return 1;
+  }
+
+  return differ || hoursDiffer || _peakBytes > SEGMENT_BUDGET || _invalid || _strays || _edgeOverflows ? 1 : 0;
+}
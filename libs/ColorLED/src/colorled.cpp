@@ -16,11 +16,60 @@
   along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <metrics.h>
+
 #include "colorled.h"
 
+static Counter _updates("elmer_led_updates_total", "LED task runs");
+static Counter _pwmWrites("elmer_led_pwm_writes_total", "PWM channel writes");
+
+// Pattern tables
+static const LedStep ERROR_STEPS[] PROGMEM = {
+    { 255, 0, 0, ColorLED::STEP, 250 },
+    { 0, 0, 0, ColorLED::STEP, 250 },
+};
+
+// Slow blue breathing while the access point is up
+static const LedStep SYNC_STEPS[] PROGMEM = {
+    { 0, 0, 255, ColorLED::EASE, 1000 },
+    { 0, 0, 16, ColorLED::EASE, 1000 },
+};
+
+// Yellow double flash, then a pause
+static const LedStep FLASH_FULL_STEPS[] PROGMEM = {
+    { 255, 255, 0, ColorLED::STEP, 120 },
+    { 0, 0, 0, ColorLED::STEP, 120 },
+    { 255, 255, 0, ColorLED::STEP, 120 },
+    { 0, 0, 0, ColorLED::STEP, 1640 },
+};
+
+// A short dim green pulse every few seconds: alive and counting
+static const LedStep HEARTBEAT_STEPS[] PROGMEM = {
+    { 0, 48, 0, ColorLED::LINEAR, 150 },
+    { 0, 0, 0, ColorLED::LINEAR, 250 },
+    { 0, 0, 0, ColorLED::STEP, 4600 },
+};
+
+#define PATTERN(steps, repeat)  { steps, sizeof(steps) / sizeof(steps[0]), repeat }
+
+const LedPattern LED_PATTERN_ERROR = PATTERN(ERROR_STEPS, -1);
+const LedPattern LED_PATTERN_SYNC = PATTERN(SYNC_STEPS, -1);
+const LedPattern LED_PATTERN_FLASH_FULL = PATTERN(FLASH_FULL_STEPS, -1);
+const LedPattern LED_PATTERN_HEARTBEAT = PATTERN(HEARTBEAT_STEPS, -1);
+
+// Reads a step from the table; memcpy_P also reads RAM, which on() and blink() use
+static inline void readStep(const LedPattern& pattern, uint8_t index, LedStep& step)
+{
+    memcpy_P(&step, &pattern.steps[index], sizeof(step));
+}
+
 ColorLED::ColorLED(uint8_t redPin, uint8_t greenPin, uint8_t bluePin)
 {
-    _state = IDLE;
+    _task = -1;
+    _active = -1;
+    memset(_layers, 0, sizeof(_layers));
+    memset(_rgb, 0, sizeof(_rgb));
+    memset(_from, 0, sizeof(_from));
 
     _redPin = redPin;
     _greenPin = greenPin;
@@ -32,92 +81,191 @@ void ColorLED::begin()
     pinMode(_redPin, OUTPUT);
     pinMode(_greenPin, OUTPUT);
     pinMode(_bluePin, OUTPUT);
+
+    // Known state, so later writes can be skipped when nothing changes
+    analogWrite(_redPin, 0);
+    analogWrite(_greenPin, 0);
+    analogWrite(_bluePin, 0);
+    memset(_rgb, 0, sizeof(_rgb));
+
+    if (_task < 0)
+      _task = _scheduler.add("led", onTask, this);
 }
 
-void ColorLED::applyColor(Color color)
+void ColorLED::onTask(void* arg)
 {
-    switch (color) {
-        case Color::RED:
-          applyRGB(255, 0, 0);
-          break;
-        case Color::GREEN:
-          applyRGB(0, 255, 0);
-          break;
-        case Color::BLUE:
-          applyRGB(0, 0, 255);
-          break;
-        case Color::YELLOW:
-          applyRGB(255, 255, 0);
-          break;
-        case Color::CYAN:
-          applyRGB(0, 255, 255);
-          break;
-        case Color::MAGENTA:
-          applyRGB(255, 0, 255);
-          break;
-        case Color::WHITE:
-          applyRGB(255, 255, 255);
-          break;
-    }
+    static_cast<ColorLED*>(arg)->update();
+}
+
+void ColorLED::colorRGB(Color color, LedStep& step)
+{
+    static const uint8_t rgb[][3] PROGMEM = {
+        { 255, 0, 0 },      // RED
+        { 0, 255, 0 },      // GREEN
+        { 0, 0, 255 },      // BLUE
+        { 255, 0, 255 },    // MAGENTA
+        { 0, 255, 255 },    // CYAN
+        { 255, 255, 0 },    // YELLOW
+        { 255, 255, 255 },  // WHITE
+    };
+
+    step.red = pgm_read_byte(&rgb[color][0]);
+    step.green = pgm_read_byte(&rgb[color][1]);
+    step.blue = pgm_read_byte(&rgb[color][2]);
 }
 
 void ColorLED::applyRGB(uint8_t red, uint8_t green, uint8_t blue)
 {
-    analogWrite(_redPin, red);
-    analogWrite(_greenPin, green);
-    analogWrite(_bluePin, blue);
+    if (red != _rgb[0]) {
+      analogWrite(_redPin, red);
+      _pwmWrites.add();
+    }
+    if (green != _rgb[1]) {
+      analogWrite(_greenPin, green);
+      _pwmWrites.add();
+    }
+    if (blue != _rgb[2]) {
+      analogWrite(_bluePin, blue);
+      _pwmWrites.add();
+    }
+
+    _rgb[0] = red;
+    _rgb[1] = green;
+    _rgb[2] = blue;
+}
+
+void ColorLED::play(const LedPattern& pattern, Priority priority)
+{
+    Layer& layer = _layers[priority];
+
+    layer.pattern = &pattern;
+    layer.step = 0;
+    layer.repeatsLeft = pattern.repeat;
+
+    if (priority >= _active) {
+      _active = -1;   // (re)start it even if it was already showing
+      select();
+    }
+}
+
+void ColorLED::stop(Priority priority)
+{
+    _layers[priority].pattern = nullptr;
+    if (priority == _active)
+      select();
+}
+
+// Show the highest layer playing; a layer coming back restarts its step
+void ColorLED::select()
+{
+    int8_t active = PRIORITIES - 1;
+    while (active >= 0 && !_layers[active].pattern)
+      active--;
+
+    if (active == _active)
+      return;
+
+    _active = active;
+    if (active < 0) {
+      applyRGB(0, 0, 0);
+      _scheduler.stop(_task);
+      return;
+    }
+
+    startStep(_layers[active], millis());
+    update();
+}
+
+void ColorLED::startStep(Layer& layer, unsigned long now)
+{
+    layer.stepStart = now;
+    memcpy(_from, _rgb, sizeof(_from));
 }
 
 void ColorLED::on(Color color)
 {
-    applyColor(color);
-    _state = IDLE;
+    _customSteps[0] = { 0, 0, 0, STEP, 0 };
+    colorRGB(color, _customSteps[0]);
+    _custom = { _customSteps, 1, 1 };
+    play(_custom, STATUS);
 }
 
 void ColorLED::off()
 {
-    applyRGB(0, 0, 0);
-    _state = IDLE;
+    stop(STATUS);
 }
 
 void ColorLED::blink(Color color, int onDuration, int offDuration, int repeatCount)
 {
-    _onDuration = onDuration;
-    _offDuration = offDuration;
-    _repeatCount = repeatCount;
-
-    _currentRepeat = 0;
-    _lastChange = millis();
-
-    _currentColor = color;
-    applyColor(color);
+    _customSteps[0] = { 0, 0, 0, STEP, (uint16_t)onDuration };
+    colorRGB(color, _customSteps[0]);
+    _customSteps[1] = { 0, 0, 0, STEP, (uint16_t)offDuration };
+    // Like before, 0 still blinks once and a negative count forever
+    int8_t repeat = repeatCount < 0 || repeatCount > INT8_MAX ? -1 : repeatCount ? repeatCount : 1;
+    _custom = { _customSteps, 2, repeat };
+    play(_custom, STATUS);
+}
 
-    _state = ON;
+void ColorLED::error()
+{
+    play(LED_PATTERN_ERROR, ALERT);
 }
 
+// Renders the active layer and sleeps until its next step, or the next frame
+// while it fades. A held color costs nothing until it is replaced.
 void ColorLED::update()
 {
-    switch (_state) {
-        case ON:
-            if (millis() - _lastChange < (unsigned long)_onDuration)
-              break;
-
-            off();
-            _lastChange = millis();
-            _state = OFF;
-            break;
-
-        case OFF:
-            if (millis() - _lastChange < (unsigned long)_offDuration)
-              break;
-
-            if (_repeatCount == -1 || ++_currentRepeat < _repeatCount) {
-                applyColor(_currentColor);
-                _lastChange = millis();
-                _state = ON;
-            } else
-                _state = IDLE;
-            break;
+    if (_active < 0)
+      return;
+
+    _updates.add();
+    Layer& layer = _layers[_active];
+    unsigned long now = millis();
+    LedStep step;
+
+    readStep(*layer.pattern, layer.step, step);
+
+    // Finished steps; a late run skips ahead instead of replaying them
+    while (step.durationMs && now - layer.stepStart >= step.durationMs) {
+      unsigned long end = layer.stepStart + step.durationMs;
+
+      if (++layer.step == layer.pattern->count) {
+        layer.step = 0;
+        if (layer.repeatsLeft > 0 && --layer.repeatsLeft == 0) {
+          applyRGB(step.red, step.green, step.blue);
+          stop((Priority)_active);
+          return;
+        }
+      }
+
+      applyRGB(step.red, step.green, step.blue);
+      startStep(layer, end);
+      readStep(*layer.pattern, layer.step, step);
     }
-}
 
+    uint32_t elapsed = now - layer.stepStart;
+    uint32_t next = step.durationMs ? step.durationMs - elapsed : 0;
+
+    if (step.curve == STEP || elapsed >= step.durationMs)
+      applyRGB(step.red, step.green, step.blue);
+    else {
+      // 0..256 along the step, eased with smoothstep
+      uint32_t t = (elapsed << 8) / step.durationMs;
+      if (step.curve == EASE)
+        t = (t * t * (768 - 2 * t)) >> 16;
+
+      const uint8_t to[3] = { step.red, step.green, step.blue };
+      uint8_t rgb[3];
+      for (uint8_t i = 0; i < 3; i++)
+        rgb[i] = _from[i] + (((int)to[i] - _from[i]) * (int)t >> 8);
+      applyRGB(rgb[0], rgb[1], rgb[2]);
+
+      if (next > LED_FRAME_MS)
+        next = LED_FRAME_MS;
+    }
+
+    if (next)
+      _scheduler.wake(_task, next);
+    else
+      _scheduler.stop(_task);
+}
@@ -19,37 +19,78 @@
 #pragma once
 
 #include <Arduino.h>
+#include <scheduler.h>
+
+#define LED_FRAME_MS  20    // update period while fading
+
+// One step of a pattern: fade (or jump) to a color, then hold it for the rest
+// of the duration. A duration of 0 holds the color until the pattern is replaced.
+struct LedStep {
+    uint8_t red, green, blue;
+    uint8_t curve;          // ColorLED::Curve
+    uint16_t durationMs;
+};
+
+// Steps live in PROGMEM; repeat -1 loops forever
+struct LedPattern {
+    const LedStep* steps;
+    uint8_t count;
+    int8_t repeat;
+};
 
 class ColorLED
 {
 public:
     enum Color { RED, GREEN, BLUE, MAGENTA, CYAN, YELLOW, WHITE };
+    enum Curve { STEP, LINEAR, EASE };      // how a step fades in from the previous color
+    enum Priority { STATUS, NOTICE, ALERT, PRIORITIES };  // a higher one hides the lower ones
 
     ColorLED(uint8_t redPin, uint8_t greenPin, uint8_t bluePin);
 
     void begin();
 
+    void play(const LedPattern& pattern, Priority priority = STATUS);
+    void stop(Priority priority);
+
+    // Status layer shortcuts
     void on(Color color);
     void off();
     void blink(Color color, int onDuration, int offDuration, int repeatCount);
 
-    inline void error() { blink(Color::RED, 250, 250, -1); }  // blink red, 250ms on, 250ms off, repeat forever
+    void error();   // blink red, 250ms on, 250ms off, repeat forever, over any status pattern
 
-    void update();  // Call regularly from loop()
+    void update();  // Runs as a scheduler task at each step and fade frame
 
 private:
+    struct Layer {
+        const LedPattern* pattern;  // null when idle
+        uint8_t step;
+        int8_t repeatsLeft;
+        unsigned long stepStart;
+    };
+
     uint8_t _redPin, _greenPin, _bluePin;
+    uint8_t _rgb[3];        // as last written, so unchanged channels are skipped
+    uint8_t _from[3];       // color the current step fades from
+
+    Layer _layers[PRIORITIES];
+    int8_t _active;         // highest layer playing, or -1
 
-    enum State { IDLE, ON, OFF };
-    State _state;
+    LedPattern _custom;     // on() and blink() build their steps here
+    LedStep _customSteps[2];
 
-    unsigned long _lastChange;
-    int _onDuration;
-    int _offDuration;
-    int _repeatCount;
-    int _currentRepeat;
-    Color _currentColor;
+    int8_t _task;
 
-    void applyColor(Color color);
+    static void onTask(void* arg);
+    static void colorRGB(Color color, LedStep& step);
+
+    void select();
+    void startStep(Layer& layer, unsigned long now);
     void applyRGB(uint8_t red, uint8_t green, uint8_t blue);
 };
+
+// Patterns for the common states
+extern const LedPattern LED_PATTERN_ERROR;
+extern const LedPattern LED_PATTERN_SYNC;
+extern const LedPattern LED_PATTERN_FLASH_FULL;
+extern const LedPattern LED_PATTERN_HEARTBEAT;
@@ -39,36 +39,15 @@ void Debouncer::begin(int mode)
         _state |= STATE_DEBOUNCED | STATE_UNSTABLE;
 
     _millisPrevious = millis();
+    _stateChangeLastTime = _millisPrevious;
 }
 
 void Debouncer::update()
 {
     _state &= ~STATE_CHANGED;
 
-    // Read the state of the switch in a temporary variable.
-    bool currentState = digitalRead(_pin);
-
-    // If the reading is different from last reading, reset the debounce counter
-    if (currentState != (_state & STATE_UNSTABLE)) {
-        _millisPrevious = millis();
-        _state ^= STATE_UNSTABLE;
-    } else if (millis() - _millisPrevious >= _millisInterval) {
-        // We have passed the threshold time, so the input is now stable
-        // If it is different from last state, set the STATE_CHANGED flag
-        if (currentState != _state & STATE_DEBOUNCED) {
-            _millisPrevious = millis();
-            changeState();
-        }
-    }
-}
-
-void Debouncer::changeState()
-{
-	_state ^= STATE_DEBOUNCED;
-	_state |= STATE_CHANGED;
-
-    _durationOfPreviousState = millis() - _stateChangeLastTime;
-	_stateChangeLastTime = millis();
+    if (StablePolicy::update(_state, _millisPrevious, digitalRead(_pin), millis(), _millisInterval))
+        changeState();
 }
 
 // Prompt detection debouncer
@@ -76,26 +55,8 @@ void PromptDebouncer::update()
 {
     _state &= ~STATE_CHANGED;
 
-    // Read the state of the switch port into a temporary variable.
-    bool readState = digitalRead(_pin);
-    if (readState != (_state & STATE_DEBOUNCED)) {
-      // We have seen a change from the current button state.
-      if (millis() - _millisPrevious >= _millisInterval) {
-        // We have passed the time threshold, so a new change of state is allowed.
-        // set the STATE_CHANGED flag and the new DEBOUNCED_STATE.
-        // This will be prompt as long as there has been greater than interval_misllis ms since last change of input.
-        // Otherwise debounced state will not change again until bouncing is stable for the timeout period.
+    if (PromptPolicy::update(_state, _millisPrevious, digitalRead(_pin), millis(), _millisInterval))
         changeState();
-      }
-    }
-
-    // If the readState is different from previous readState, reset the debounce timer - as input is still unstable
-    // and we want to prevent new button state changes until the previous one has remained stable for the timeout.
-    if (readState != (_state & STATE_UNSTABLE)) {
-        // Update Unstable Bit to macth readState
-        _state ^= STATE_UNSTABLE;
-        _millisPrevious = millis();
-    }
 }
 
 // Lock out debouncer
@@ -110,13 +71,56 @@ void LockOutDebouncer::update()
 {
     _state &= ~STATE_CHANGED;
 
-    // Ignore everything if we are locked out
-    if (millis() - _millisPrevious >= _millisInterval) {
-        bool currentState = digitalRead(_pin);
-        if (currentState != (_state & STATE_DEBOUNCED)) {
-            _millisPrevious = millis();
-            changeState();
-        }
-    }
+    if (LockOutPolicy::update(_state, _millisPrevious, digitalRead(_pin), millis(), _millisInterval))
+        changeState();
+}
+
+// Vertical debouncer
+VerticalDebouncer::VerticalDebouncer(uint8_t ticks, Mode mode)
+{
+  _ticks = ticks < (1 << VERTICAL_BITS) ? ticks : (1 << VERTICAL_BITS) - 1;
+  _mode = mode;
+
+  for (uint8_t i = 0; i < VERTICAL_BITS; i++)
+    _threshold[i] = (_ticks >> i & 1) ? ~0u : 0;
+}
+
+void VerticalDebouncer::begin(uint32_t inputs)
+{
+  _debounced = _unstable = inputs;
+  _changed = 0;
+
+  // Like the per-pin classes: the interval starts now, but nothing is locked out
+  for (uint8_t i = 0; i < VERTICAL_BITS; i++)
+    _count[i] = _mode == LOCK_OUT ? _threshold[i] : 0;
 }
 
+void VerticalDebouncer::update(uint32_t inputs)
+{
+  uint32_t moved = inputs ^ _unstable;   // raw changes since the last tick
+
+  _unstable = inputs;
+  advance();
+
+  switch (_mode) {
+    case STABLE:
+      // A raw change restarts the interval; a level that held for it is taken
+      reset(moved);
+      _changed = (inputs ^ _debounced) & saturated();
+      break;
+
+    case PROMPT:
+      // A change is taken at once if the input was quiet for the interval
+      _changed = (inputs ^ _debounced) & saturated();
+      reset(moved);
+      break;
+
+    case LOCK_OUT:
+      // Changes are ignored for the interval after a debounced change
+      _changed = (inputs ^ _debounced) & saturated();
+      reset(_changed);
+      break;
+  }
+
+  _debounced ^= _changed;
+}
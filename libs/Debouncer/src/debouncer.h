@@ -29,13 +29,82 @@
 #define STATE_UNSTABLE  0b00000010    // Actual last state value behind the scene
 #define STATE_CHANGED   0b00000100    // The DEBOUNCED_STATE has changed since last update()
 
+#define VERTICAL_BITS   6             // Counter planes of VerticalDebouncer: up to 63 ticks
+
+/**
+    @brief Debounce rules shared by the Debouncer classes and StaticDebouncer.
+    update() takes one sample and its time, moves STATE_UNSTABLE and the
+    interval start along, and returns true when the debounced state should
+    change. start() is the interval start at begin().
+*/
+struct StablePolicy
+{
+  // A level counts once it held for the interval
+  static inline bool update(uint8_t& state, uint32_t& previous, bool level, uint32_t now, uint32_t interval)
+  {
+    if (level != ((state & STATE_UNSTABLE) != 0)) {
+      state ^= STATE_UNSTABLE;
+      previous = now;
+      return false;
+    }
+    if (now - previous >= interval && level != ((state & STATE_DEBOUNCED) != 0)) {
+      previous = now;
+      return true;
+    }
+    return false;
+  }
+
+  static inline uint32_t start(uint32_t now, uint32_t) { return now; }
+};
+
+struct PromptPolicy
+{
+  // A change counts at once if the input was quiet for the interval before it
+  static inline bool update(uint8_t& state, uint32_t& previous, bool level, uint32_t now, uint32_t interval)
+  {
+    bool change = level != ((state & STATE_DEBOUNCED) != 0) && now - previous >= interval;
+
+    if (level != ((state & STATE_UNSTABLE) != 0)) {
+      state ^= STATE_UNSTABLE;
+      previous = now;
+    }
+    return change;
+  }
+
+  static inline uint32_t start(uint32_t now, uint32_t) { return now; }
+};
+
+struct LockOutPolicy
+{
+  // A change counts at once, then the input is ignored for the interval
+  static inline bool update(uint8_t& state, uint32_t& previous, bool level, uint32_t now, uint32_t interval)
+  {
+    if (now - previous >= interval && level != ((state & STATE_DEBOUNCED) != 0)) {
+      previous = now;
+      return true;
+    }
+    return false;
+  }
+
+  static inline uint32_t start(uint32_t now, uint32_t interval) { return now - interval; }
+};
+
 /**
      @brief  The Debouce class. Just the deboucing code separated from all harware.
 */
 class Debouncer
 {
 protected:
-    inline void changeState();
+    inline bool stateFlag(uint8_t flag) const { return (_state & flag) != 0; }
+
+    inline void changeState()
+    {
+        _state ^= STATE_DEBOUNCED;
+        _state |= STATE_CHANGED;
+
+        _durationOfPreviousState = millis() - _stateChangeLastTime;
+        _stateChangeLastTime = millis();
+    }
 
 public:
 /*!
@@ -67,13 +136,13 @@ public:
 /**
     @brief Returns true if pin signal transitions from low to high.
 */
-    inline bool rose() const { return _state & (STATE_DEBOUNCED | STATE_CHANGED); }
+    inline bool rose() const { return (_state & (STATE_DEBOUNCED | STATE_CHANGED)) == (STATE_DEBOUNCED | STATE_CHANGED); }
 
 protected:
   uint8_t _pin;
   uint8_t _state;
 
-  unsigned long _millisPrevious;
+  uint32_t _millisPrevious;
   uint16_t _millisInterval;
 
   unsigned long _stateChangeLastTime;
@@ -83,13 +152,119 @@ protected:
 class PromptDebouncer : public Debouncer
 {
 public:
+  using Debouncer::Debouncer;
+
   void update() override;
 };
 
 class LockOutDebouncer : public Debouncer
 {
 public:
+  using Debouncer::Debouncer;
+
   void begin(int pinMode) override;
   void update() override;
 };
 
+/**
+    @brief Debouncer with the rule and interval fixed at compile time, e.g.
+    StaticDebouncer<StablePolicy, 15>. Nothing is virtual, so update()
+    inlines into the caller with a constant threshold, and it samples the
+    clock once: micros(), which is cheaper than millis() on the ESP8266.
+*/
+template <typename Policy, uint16_t IntervalMs>
+class StaticDebouncer
+{
+public:
+  static constexpr uint32_t INTERVAL_MICROS = IntervalMs * 1000UL;
+
+  explicit StaticDebouncer(uint8_t pin) : _pin(pin), _state(0), _previous(0) {}
+
+  inline void begin(int mode)
+  {
+    pinMode(_pin, mode);
+    _state = digitalRead(_pin) ? STATE_DEBOUNCED | STATE_UNSTABLE : 0;
+    _previous = Policy::start(micros(), INTERVAL_MICROS);
+  }
+
+  inline void update() { update(digitalRead(_pin), micros()); }
+
+  // A sample taken elsewhere, e.g. an edge timestamped by an interrupt
+  inline void update(bool level, uint32_t nowMicros)
+  {
+    _state &= ~STATE_CHANGED;
+    if (Policy::update(_state, _previous, level, nowMicros, INTERVAL_MICROS))
+      _state ^= STATE_DEBOUNCED | STATE_CHANGED;
+  }
+
+  inline uint8_t pin() const { return _pin; }
+  inline bool unstable() const { return _state & STATE_UNSTABLE; }   // Last raw level
+  inline uint32_t since() const { return _previous; }   // With StablePolicy, micros() of the last raw change
+  inline bool read() const { return _state & STATE_DEBOUNCED; }
+  inline bool fell() const { return (_state & (STATE_DEBOUNCED | STATE_CHANGED)) == STATE_CHANGED; }
+  inline bool rose() const { return (_state & (STATE_DEBOUNCED | STATE_CHANGED)) == (STATE_DEBOUNCED | STATE_CHANGED); }
+
+private:
+  uint8_t _pin;
+  uint8_t _state;
+  uint32_t _previous;   // micros() the interval started
+};
+
+/**
+    @brief Debounces up to 32 inputs at once from a snapshot such as GPI.
+    Each input gets a saturating counter of sample ticks, stored vertically:
+    bit i of every input lives in one word, so a tick costs the same bitwise
+    operations for 1 or 32 inputs and no timestamps are kept. Call update()
+    once per tick; the interval is counted in ticks, so with a 1 ms tick the
+    three modes match Debouncer, PromptDebouncer and LockOutDebouncer.
+*/
+class VerticalDebouncer
+{
+public:
+  enum Mode { STABLE, PROMPT, LOCK_OUT };
+
+  VerticalDebouncer(uint8_t ticks, Mode mode = STABLE);
+
+  void begin(uint32_t inputs);
+  void update(uint32_t inputs);
+
+  inline uint32_t read() const { return _debounced; }
+  inline uint32_t fell() const { return _changed & ~_debounced; }   // Inputs that went from high to low
+  inline uint32_t rose() const { return _changed & _debounced; }    // Inputs that went from low to high
+
+private:
+  // Inputs whose counter reached the interval
+  inline uint32_t saturated() const
+  {
+    uint32_t match = ~0u;
+    for (uint8_t i = 0; i < VERTICAL_BITS; i++)
+      match &= ~(_count[i] ^ _threshold[i]);
+    return match;
+  }
+
+  // Ripple-carry increment of every counter not yet saturated
+  inline void advance()
+  {
+    uint32_t carry = ~saturated();
+    for (uint8_t i = 0; i < VERTICAL_BITS; i++) {
+      uint32_t next = _count[i] & carry;
+      _count[i] ^= carry;
+      carry = next;
+    }
+  }
+
+  inline void reset(uint32_t inputs)
+  {
+    for (uint8_t i = 0; i < VERTICAL_BITS; i++)
+      _count[i] &= ~inputs;
+  }
+
+  uint32_t _count[VERTICAL_BITS];
+  uint32_t _threshold[VERTICAL_BITS];   // the interval, one bit spread over a whole plane
+  uint32_t _debounced;
+  uint32_t _unstable;
+  uint32_t _changed;
+  uint8_t _ticks;
+  Mode _mode;
+};
+
@@ -0,0 +1,241 @@
+/*
+  EventLog - imple and flexible event logging utility for Arduino projects.
+  Copyright (c) 2025 gadefoxren@gmail.com
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "eventformat.h"
+
+#define SPEC_SIZE  24
+
+enum ArgType { ARG_NONE, ARG_INT, ARG_LONG, ARG_LLONG, ARG_SIZE, ARG_DOUBLE, ARG_STRING, ARG_POINTER };
+
+struct Spec {
+  const char* start;
+  const char* end;      // one past the conversion character
+  uint8_t stars;        // '*' width/precision taking an int argument each
+  ArgType type;
+};
+
+// Parses the conversion starting at '%'; ARG_NONE for "%%" and unsupported ones
+static const char* parseSpec(const char* p, Spec& spec)
+{
+  uint8_t longs = 0;
+  bool size = false;
+
+  spec.start = p++;
+  spec.stars = 0;
+  spec.type = ARG_NONE;
+
+  while (*p && strchr("-+ #0123456789.*", *p))
+    if (*p++ == '*')
+      spec.stars++;
+
+  while (*p && strchr("hlzjt", *p)) {
+    if (*p == 'l')
+      longs++;
+    else if (*p != 'h')
+      size = true;
+    p++;
+  }
+
+  if (!*p) {
+    spec.end = p;
+    return p;
+  }
+
+  switch (*p) {
+    case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+      spec.type = size ? ARG_SIZE : longs >= 2 ? ARG_LLONG : longs ? ARG_LONG : ARG_INT;
+      break;
+    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+      spec.type = ARG_DOUBLE;
+      break;
+    case 's':
+      spec.type = ARG_STRING;
+      break;
+    case 'p':
+      spec.type = ARG_POINTER;
+      break;
+  }
+
+  spec.end = ++p;
+  return p;
+}
+
+static inline size_t argSize(ArgType type)
+{
+  switch (type) {
+    case ARG_INT:     return sizeof(int);
+    case ARG_LONG:    return sizeof(long);
+    case ARG_LLONG:   return sizeof(long long);
+    case ARG_SIZE:    return sizeof(size_t);
+    case ARG_DOUBLE:  return sizeof(double);
+    case ARG_POINTER: return sizeof(void*);
+    default:          return 0;
+  }
+}
+
+size_t packEventArgs(uint8_t* out, size_t size, const char* format, va_list args)
+{
+  size_t used = 0;
+  Spec spec;
+
+  for (const char* p = format; *p; ) {
+    if (*p != '%') {
+      p++;
+      continue;
+    }
+
+    p = parseSpec(p, spec);
+    if (spec.type == ARG_NONE)
+      continue;
+
+    for (uint8_t i = 0; i < spec.stars; i++) {
+      int value = va_arg(args, int);
+      if (used + sizeof(value) > size)
+        return used;
+      memcpy(out + used, &value, sizeof(value));
+      used += sizeof(value);
+    }
+
+    union {
+      int i;
+      long l;
+      long long ll;
+      size_t z;
+      double d;
+      void* p;
+    } value;
+
+    switch (spec.type) {
+      case ARG_INT:     value.i = va_arg(args, int); break;
+      case ARG_LONG:    value.l = va_arg(args, long); break;
+      case ARG_LLONG:   value.ll = va_arg(args, long long); break;
+      case ARG_SIZE:    value.z = va_arg(args, size_t); break;
+      case ARG_DOUBLE:  value.d = va_arg(args, double); break;
+      case ARG_POINTER: value.p = va_arg(args, void*); break;
+
+      case ARG_STRING: {
+        const char* str = va_arg(args, const char*);
+        size_t len = str ? strnlen(str, EVENT_MAX_STRING) : 0;
+        if (used + 1 + len > size)
+          return used;
+
+        out[used++] = len;
+        memcpy(out + used, str, len);
+        used += len;
+        continue;
+      }
+
+      default:
+        continue;
+    }
+
+    size_t len = argSize(spec.type);
+    if (used + len > size)
+      return used;
+    memcpy(out + used, &value, len);
+    used += len;
+  }
+
+  return used;
+}
+
+size_t renderEvent(char* out, size_t size, const char* format, const uint8_t* args, size_t argLen)
+{
+  size_t len = 0, pos = 0;
+  Spec spec;
+
+  if (size == 0)
+    return 0;
+
+  for (const char* p = format; *p && len + 1 < size; ) {
+    if (*p != '%') {
+      out[len++] = *p++;
+      continue;
+    }
+
+    p = parseSpec(p, spec);
+    if (spec.type == ARG_NONE) {
+      if (spec.end - spec.start == 2 && spec.start[1] == '%')
+        out[len++] = '%';
+      continue;
+    }
+
+    // Rebuild the conversion with '*' replaced by the captured values
+    char conversion[SPEC_SIZE];
+    size_t n = 0;
+    for (const char* c = spec.start; c < spec.end && n + 12 < sizeof(conversion); c++) {
+      int star;
+      if (*c != '*') {
+        conversion[n++] = *c;
+      } else if (pos + sizeof(star) <= argLen) {
+        memcpy(&star, args + pos, sizeof(star));
+        pos += sizeof(star);
+        n += snprintf(conversion + n, sizeof(conversion) - n, "%d", star);
+      }
+    }
+    conversion[n] = 0;
+
+    char* dest = out + len;
+    size_t room = size - len;
+    int written = -1;
+
+    if (spec.type == ARG_STRING) {
+      if (pos < argLen && pos + 1 + args[pos] <= argLen) {
+        char str[EVENT_MAX_STRING + 1];
+        memcpy(str, args + pos + 1, args[pos]);
+        str[args[pos]] = 0;
+        pos += 1 + args[pos];
+        written = snprintf(dest, room, conversion, str);
+      }
+    } else if (pos + argSize(spec.type) <= argLen) {
+      union {
+        int i;
+        long l;
+        long long ll;
+        size_t z;
+        double d;
+        void* p;
+      } value;
+
+      memcpy(&value, args + pos, argSize(spec.type));
+      pos += argSize(spec.type);
+
+      switch (spec.type) {
+        case ARG_INT:     written = snprintf(dest, room, conversion, value.i); break;
+        case ARG_LONG:    written = snprintf(dest, room, conversion, value.l); break;
+        case ARG_LLONG:   written = snprintf(dest, room, conversion, value.ll); break;
+        case ARG_SIZE:    written = snprintf(dest, room, conversion, value.z); break;
+        case ARG_DOUBLE:  written = snprintf(dest, room, conversion, value.d); break;
+        case ARG_POINTER: written = snprintf(dest, room, conversion, value.p); break;
+        default:          break;
+      }
+    }
+
+    // Arguments cut off when the record was packed
+    if (written < 0)
+      written = snprintf(dest, room, "?");
+
+    len += (size_t)written < room ? written : room - 1;
+  }
+
+  out[len] = 0;
+  return len;
+}
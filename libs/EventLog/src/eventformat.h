@@ -0,0 +1,33 @@
+/*
+  EventLog - imple and flexible event logging utility for Arduino projects.
+  Copyright (c) 2025 gadefoxren@gmail.com
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define EVENT_MAX_ARGS    64    // bytes of captured arguments per record
+#define EVENT_MAX_STRING  32    // %s arguments are copied up to this length
+
+// Copies the raw arguments that printf-style `format` consumes into out.
+// Strings are copied inline since the pointer may not outlive the call.
+size_t packEventArgs(uint8_t* out, size_t size, const char* format, va_list args);
+
+// vsnprintf() counterpart taking the arguments from a packEventArgs() buffer
+size_t renderEvent(char* out, size_t size, const char* format, const uint8_t* args, size_t argLen);
@@ -17,6 +17,7 @@
 */
 
 #include <LittleFS.h>
+#include <metrics.h>
 #include <stdarg.h>
 
 #include "eventlog.h"
@@ -24,39 +25,131 @@
 // Global implementation
 EventLog _events;
 const char _eventlog_path[] = "/events.log";
+const char _eventlog_bin_path[] = "/events.bin";
+const char _eventlog_gen_path[] = "/events.gen";
 const char _monthAbbreviations[12][4] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
 
+static Histogram _logTime("elmer_eventlog_log_seconds", "EventLog::log() until the message is buffered");
+static Counter _bytesWritten("elmer_eventlog_bytes_written_total", "Event log bytes written to flash");
+static Counter _droppedTotal("elmer_eventlog_dropped_total", "Messages dropped because the buffer was full", []() -> uint32_t { return _events.dropped(); });
+static Counter _coalescedTotal("elmer_eventlog_coalesced_total", "Messages folded into a repeat count", []() -> uint32_t { return _events.coalesced(); });
+
+// Frames look like records to EventReader: chunk length for the timestamp, CRC for the format
+static void encodeFrame(uint8_t* out, uint32_t len, uint32_t crc)
+{
+  memcpy(out, &len, 4);
+  out[4] = EVENT_FRAME;
+  out[5] = 0;
+  memcpy(out + 6, &crc, 4);
+}
+
+static bool decodeFrame(const uint8_t* frame, uint32_t& len, uint32_t& crc)
+{
+  if (frame[4] != EVENT_FRAME || frame[5] != 0)
+    return false;
+
+  memcpy(&len, frame, 4);
+  memcpy(&crc, frame + 6, 4);
+  return true;
+}
+
+static const StorageFraming _eventFraming = { EVENT_RECORD_HEADER, encodeFrame, decodeFrame };
+
+static_assert(EVENT_BUFFER_SIZE <= STORAGE_MAX_CHUNK, "A flushed buffer is one framed chunk");
+
 // Class implementation
 EventLog::EventLog()
 {
+  _format = TEXT;
+  _generation = 0;
+  _session = 0;
   _day = 0;
   _month = UINT8_MAX;
   _year = 0;
+
+  _used = 0;
+  _bufferSince = 0;
+  _flushThreshold = EVENT_BUFFER_SIZE * 3 / 4;
+  _flushDelay = 60000;
+  _task = -1;
+
+  _lastHash = 0;
+  _repeats = 0;
+  _dropped = 0;
+  _coalesced = 0;
 }
 
 EventLog::~EventLog()
 {
+    sync();
+
     if (_logFile)
       _logFile.close();
 }
 
 // Open log file in append mode
-bool EventLog::begin()
+bool EventLog::begin(Format format)
 {
     time_t now = time(nullptr);
     struct tm *t = localtime(&now);
 
-    _logFile = LittleFS.open(_eventlog_path, "a");
-    if (!_logFile)
+    // Polls rather than being woken by append(): log() and sync() are also
+    // called from web handlers, in the async TCP context, where the timer
+    // wheel that loop() walks must not be relinked
+    if (_task < 0)
+      _task = _scheduler.every("events", EVENT_POLL_MS, onTask, this);
+
+    _format = format;
+    loadGeneration();
+    if (!_logFile.open(path(), format == BINARY ? &_eventFraming : nullptr))
       return false;
 
-    writeHeader(t->tm_mday, t->tm_mon, t->tm_year);
-    _logFile.flush();
+    _session = _logFile.size() + _used;
+    if (format == BINARY) {
+      // Format locations are only meaningful to the build that wrote them
+      uint8_t record[EVENT_RECORD_HEADER];
+      uint32_t timestamp = now;
+      uint32_t build = buildId();
+
+      memcpy(record, &timestamp, 4);
+      record[4] = EVENT_SESSION;
+      record[5] = 0;
+      memcpy(record + 6, &build, 4);
+      append(record, sizeof(record));
+    } else {
+      char header[EVENT_HEADER_SIZE];
+      append((const uint8_t*)header, writeHeader(header, t->tm_mday, t->tm_mon, t->tm_year));
+    }
+
+    sync();
+
+    if (_logFile.recovered())
+      log(WARN, PSTR("Event log: cut %lu torn bytes"), (unsigned long)_logFile.recovered());
     return true;
 }
 
+void EventLog::setFlushPolicy(size_t threshold, uint32_t delayMs)
+{
+    _flushThreshold = threshold < EVENT_BUFFER_SIZE ? threshold : EVENT_BUFFER_SIZE;
+    _flushDelay = delayMs;
+}
+
+// First 32 bits of the sketch MD5, computed once per boot
+uint32_t EventLog::buildId()
+{
+    static uint32_t build = 0;
+
+    if (build == 0) {
+      char hex[9];
+      strncpy(hex, ESP.getSketchMD5().c_str(), 8);
+      hex[8] = 0;
+      build = strtoul(hex, nullptr, 16) | 1;
+    }
+    return build;
+}
+
 // Convert enum Level to string without default case
-const char EventLog::levelToChar(Level level)
+char EventLog::levelToChar(uint8_t level)
 {
     if (level == ERROR)
       return 'E';
@@ -65,46 +158,190 @@ const char EventLog::levelToChar(Level level)
     return 'I';
 }
 
-void EventLog::writeHeader(uint8_t day, uint8_t month, uint8_t year)
+// FNV-1a, to spot a message identical to the previous one
+uint32_t EventLog::hash(uint8_t level, const uint8_t* data, size_t len)
+{
+    uint32_t hash = 2166136261u ^ level;
+
+    hash *= 16777619u;
+    while (len--) {
+      hash ^= *data++;
+      hash *= 16777619u;
+    }
+    return hash | 1;
+}
+
+// Date lines for whatever changed since the last message
+size_t EventLog::writeHeader(char* out, uint8_t day, uint8_t month, uint8_t year)
 {
+    size_t len = 0;
+
     if (_year != year) {
       _year = year;
-      _logFile.printf("%d\n", year + 1900);
+      len += sprintf(out + len, "%d\n", year + 1900);
     }
 
     if (_month != month) {
       _month = month;
-      _logFile.printf("%s\n", _monthAbbreviations[month]);
+      len += sprintf(out + len, "%s\n", _monthAbbreviations[month]);
     }
 
     if (_day != day) {
       _day = day;
-      _logFile.printf("%02d\n", day);
+      len += sprintf(out + len, "%02d\n", day);
     }
+    return len;
+}
+
+// Appends to the RAM buffer; a message that doesn't fit is dropped until the next flush
+bool EventLog::append(const uint8_t* data, size_t len)
+{
+    if (len > sizeof(_buffer) - _used) {
+      _dropped++;
+      return false;
+    }
+
+    if (_used == 0)
+      _bufferSince = millis();
+
+    memcpy(_buffer + _used, data, len);
+    _used += len;
+    return true;
 }
 
 // Log a message with level and timestamp
-void EventLog::writeMessage(Level level, const char* message)
+bool EventLog::writeMessage(Level level, const char* message)
 {
     time_t now = time(nullptr);
     struct tm *t = localtime(&now);
+    char line[EVENT_HEADER_SIZE + 256 + 16];
+    uint8_t day = _day, month = _month, year = _year;
+
+    size_t len = writeHeader(line, t->tm_mday, t->tm_mon, t->tm_year);
+    len += snprintf(line + len, sizeof(line) - len, "%c %02d%02d%02d %s\n", levelToChar(level), t->tm_hour, t->tm_min, t->tm_sec, message);
+    if (len >= sizeof(line))
+      len = sizeof(line) - 1;
+
+    if (append((const uint8_t*)line, len))
+      return true;
+
+    // Dropped: the date lines must come again with the next message
+    _day = day;
+    _month = month;
+    _year = year;
+    return false;
+}
+
+// Binary record: timestamp, level, argument length, format location, arguments.
+// The format is stored relative to _eventlog_path so the offset fits 32 bits;
+// the addresses are subtracted as integers, since they are not in one array.
+// `pattern` is the format copied out of flash.
+size_t EventLog::packRecord(uint8_t* record, uint8_t level, const char* format, const char* pattern, va_list args)
+{
+    uint32_t timestamp = time(nullptr);
+    int32_t location = (uintptr_t)format - (uintptr_t)_eventlog_path;
 
-    writeHeader(t->tm_mday, t->tm_mon, t->tm_year);
-    _logFile.printf("%c %02d%02d%02d %s\n", levelToChar(level), t->tm_hour, t->tm_min, t->tm_sec, message);
-    _logFile.flush();
+    memcpy(record, &timestamp, 4);
+    record[4] = level;
+    record[5] = packEventArgs(record + EVENT_RECORD_HEADER, EVENT_MAX_ARGS, pattern, args);
+    memcpy(record + 6, &location, 4);
+    return EVENT_RECORD_HEADER + record[5];
+}
+
+// Write "repeated N times" for messages folded into the previous one
+void EventLog::writeRepeats()
+{
+    if (_repeats == 0)
+      return;
+
+    if (_format == BINARY) {
+      uint8_t record[EVENT_RECORD_HEADER];
+      uint32_t timestamp = time(nullptr);
+      uint32_t repeats = _repeats;
+
+      memcpy(record, &timestamp, 4);
+      record[4] = EVENT_REPEAT;
+      record[5] = 0;
+      memcpy(record + 6, &repeats, 4);
+      append(record, sizeof(record));
+    } else {
+      char message[40];
+      snprintf(message, sizeof(message), "last message repeated %u times", (unsigned)_repeats);
+      writeMessage(INFO, message);
+    }
+
+    _repeats = 0;
 }
 
 void EventLog::log(Level level, const char* format, ...)
 {
+  MetricTimer timer(_logTime);
+  uint8_t record[EVENT_RECORD_HEADER + EVENT_MAX_ARGS];
   char buffer[256];
+  char pattern[EVENT_FORMAT_SIZE];
+  uint32_t digest;
+
+  // Flash only reads in whole words, so the format is parsed from a copy
+  strncpy_P(pattern, format, sizeof(pattern) - 1);
+  pattern[sizeof(pattern) - 1] = 0;
 
   va_list args;
   va_start(args, format);
-  vsnprintf(buffer, sizeof(buffer), format, args);
+
+  if (_format == BINARY) {
+    size_t len = packRecord(record, level, format, pattern, args);
+    digest = hash(level, record + 5, len - 5);   // all but the timestamp
+  } else {
+    int len = vsnprintf(buffer, sizeof(buffer), pattern, args);
+    digest = hash(level, (const uint8_t*)buffer, len < (int)sizeof(buffer) ? len : sizeof(buffer) - 1);
+  }
+
   va_end(args);
 
-  // Call original log method with formatted string
-  writeMessage(level, buffer);
+  if (digest == _lastHash) {
+    _repeats++;
+    _coalesced++;
+  } else {
+    writeRepeats();
+
+    bool added = _format == BINARY ? append(record, EVENT_RECORD_HEADER + record[5]) : writeMessage(level, buffer);
+    _lastHash = added ? digest : 0;
+  }
+
+  // Errors must survive a crash right after them
+  if (level == ERROR)
+    sync();
+}
+
+void EventLog::onTask(void* arg)
+{
+    static_cast<EventLog*>(arg)->update();
+}
+
+void EventLog::update()
+{
+    if (_used > 0 && (_used >= _flushThreshold || millis() - _bufferSince >= _flushDelay)) {
+      writeBuffer();
+      _logFile.commit();
+    }
+}
+
+// A durability point: errors must survive a crash, readers see only what is committed
+void EventLog::sync()
+{
+    writeBuffer();
+    _logFile.commit();
+}
+
+void EventLog::writeBuffer()
+{
+    writeRepeats();
+
+    if (_used == 0 || !_logFile)
+      return;
+
+    _bytesWritten.add(_logFile.write(_buffer, _used));
+    _used = 0;
 }
 
 bool EventLog::emptyLogFile()
@@ -113,7 +350,160 @@ bool EventLog::emptyLogFile()
   _month = UINT8_MAX;
   _year = 0;
 
-  LittleFS.remove(_eventlog_path);
-  return begin();
+  _used = 0;
+  _lastHash = 0;
+  _repeats = 0;
+
+  // Saved first: readers holding a token for the old log must never match
+  // the new one, even if the device resets right after the removal
+  _generation++;
+  bool saved = saveGeneration();
+
+  _logFile.close();
+  LittleFS.remove(path());
+  if (!begin(_format))
+    return false;
+
+  if (!saved)
+    log(ERROR, PSTR("Failed to write event log generation"));
+  return true;
+}
+
+// The generation is 4 bytes next to the log; a missing file means 0
+void EventLog::loadGeneration()
+{
+  File file = LittleFS.open(_eventlog_gen_path, "r");
+  uint32_t generation;
+
+  if (file && file.read((uint8_t*)&generation, sizeof(generation)) == sizeof(generation))
+    _generation = generation;
+}
+
+bool EventLog::saveGeneration()
+{
+  File file = LittleFS.open(_eventlog_gen_path, "w");
+  return file && file.write((const uint8_t*)&_generation, sizeof(_generation)) == sizeof(_generation);
+}
+
+// Reader
+EventReader::EventReader(const char* path, size_t from, size_t to, size_t session)
+{
+  _file = LittleFS.open(path, "r");
+  _from = from;
+  _to = to;
+  _known = from >= session;
+  if (_known && _file)
+    _file.seek(from);
+  _day = 0;
+  _month = UINT8_MAX;
+  _year = 0;
+  _linePos = 0;
+  _lineLen = 0;
+}
+
+size_t EventReader::read(uint8_t* buffer, size_t len)
+{
+  size_t size = 0;
+
+  while (size < len) {
+    if (_linePos == _lineLen && !nextLine())
+      break;
+
+    size_t n = _lineLen - _linePos;
+    if (n > len - size)
+      n = len - size;
+
+    memcpy(buffer + size, _line + _linePos, n);
+    _linePos += n;
+    size += n;
+  }
+
+  return size;
+}
+
+// Renders the next record, preceded by date lines when the date changes
+bool EventReader::nextLine()
+{
+  uint8_t record[EVENT_RECORD_HEADER + EVENT_MAX_ARGS];
+  uint32_t timestamp;
+
+  for (;;) {
+    if (!_file || _file.position() >= _to)
+      return false;
+
+    size_t start = _file.position();
+    if (_file.read(record, EVENT_RECORD_HEADER) != EVENT_RECORD_HEADER)
+      return false;
+
+    uint8_t argLen = record[5];
+    if (argLen > EVENT_MAX_ARGS || _file.read(record + EVENT_RECORD_HEADER, argLen) != argLen)
+      return false;
+
+    if (record[4] == EVENT_FRAME)
+      continue;
+
+    if (record[4] == EVENT_SESSION) {
+      uint32_t build;
+      memcpy(&build, record + 6, 4);
+      _known = build == EventLog::buildId();
+      continue;
+    }
+
+    if (start >= _from)
+      break;
+  }
+
+  memcpy(&timestamp, record, 4);
+  time_t now = timestamp;
+  struct tm *t = localtime(&now);
+  size_t len = 0;
+
+  if (_year != t->tm_year) {
+    _year = t->tm_year;
+    len += snprintf(_line + len, sizeof(_line) - len, "%d\n", t->tm_year + 1900);
+  }
+
+  if (_month != t->tm_mon) {
+    _month = t->tm_mon;
+    len += snprintf(_line + len, sizeof(_line) - len, "%s\n", _monthAbbreviations[t->tm_mon]);
+  }
+
+  if (_day != t->tm_mday) {
+    _day = t->tm_mday;
+    len += snprintf(_line + len, sizeof(_line) - len, "%02d\n", t->tm_mday);
+  }
+
+  len += snprintf(_line + len, sizeof(_line) - len, "%c %02d%02d%02d ", EventLog::levelToChar(record[4]), t->tm_hour, t->tm_min, t->tm_sec);
+
+  if (record[4] == EVENT_REPEAT) {
+    uint32_t repeats;
+    memcpy(&repeats, record + 6, 4);
+    len += snprintf(_line + len, sizeof(_line) - len, "last message repeated %u times", (unsigned)repeats);
+  } else
+    len += renderRecord(_line + len, sizeof(_line) - len - 1, record, record[5]);
+  _line[len++] = '\n';
+
+  _linePos = 0;
+  _lineLen = len;
+  return true;
+}
+
+size_t EventReader::renderRecord(char* out, size_t size, const uint8_t* record, size_t argLen)
+{
+  const uint8_t* args = record + EVENT_RECORD_HEADER;
+  char pattern[EVENT_FORMAT_SIZE];
+  int32_t location;
+
+  memcpy(&location, record + 6, 4);
+  if (_known) {
+    strncpy_P(pattern, (const char*)((uintptr_t)_eventlog_path + location), sizeof(pattern) - 1);
+    pattern[sizeof(pattern) - 1] = 0;
+    return renderEvent(out, size, pattern, args, argLen);
+  }
+
+  size_t len = snprintf(out, size, "<format %+ld>", (long)location);
+  for (size_t i = 0; i < argLen && len + 3 < size; i++)
+    len += snprintf(out + len, size - len, " %02x", args[i]);
+  return len;
 }
 
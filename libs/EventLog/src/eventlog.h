@@ -20,31 +20,129 @@
 
 #include <Arduino.h>
 #include <FS.h>
+#include <scheduler.h>
+#include <storage.h>
+
+#include "eventformat.h"
+
+#define EVENT_RECORD_HEADER  10   // timestamp(4) level(1) argLen(1) format(4)
+#define EVENT_SESSION        0xFF // level of the record opening each boot
+#define EVENT_REPEAT         0xFE // level of a "repeated N times" record
+#define EVENT_FRAME          0xFD // level of a storage frame: chunk length and CRC-32 instead of timestamp and format
+#define EVENT_HEADER_SIZE    24   // date lines preceding a text message
+#define EVENT_LINE_SIZE      320  // rendered date headers plus one message
+#define EVENT_BUFFER_SIZE    1024 // RAM buffered before a flush
+#define EVENT_POLL_MS        1000 // how often the flush policy is checked
+#define EVENT_FORMAT_SIZE    96   // longest format string plus its terminator
+
+extern const char _eventlog_path[];
+extern const char _eventlog_bin_path[];
+extern const char _eventlog_gen_path[];
 
 class EventLog
 {
 public:
   enum Level { INFO, WARN, ERROR };
 
+  // TEXT formats every message when logged and is the default. BINARY stores
+  // the format string's location and the raw arguments, and formats only when
+  // the log is read.
+  enum Format { TEXT, BINARY };
+
   EventLog();
   ~EventLog();
 
-  bool begin();
+  bool begin(Format format = TEXT);
   bool emptyLogFile();
 
+  // `format` is a PSTR() literal, so it stays in flash; in BINARY mode only its
+  // location is stored
   void log(Level level, const char* format, ...);
 
+  // Messages are kept in RAM until `threshold` bytes are buffered or the oldest
+  // is `delayMs` old, then committed in one go (see StorageFile) at the next
+  // poll, up to EVENT_POLL_MS later.
+  // ERROR messages and sync() commit everything at once.
+  void setFlushPolicy(size_t threshold, uint32_t delayMs);
+  void update();  // Runs as a scheduler task every EVENT_POLL_MS
+  void sync();
+
+  inline uint32_t dropped() const { return _dropped; }      // Lost to a full buffer
+  inline uint32_t coalesced() const { return _coalesced; }  // Folded into "repeated N times"
+
+  inline Format format() const { return _format; }
+  inline size_t size() { return _logFile ? _logFile.size() : 0; }   // Bytes written so far, call sync() first
+  inline const char* path() const { return _format == BINARY ? _eventlog_bin_path : _eventlog_path; }
+  inline uint32_t generation() const { return _generation; }   // Bumped by emptyLogFile(), kept across reboots
+  inline size_t session() const { return _session; }           // Offset of this boot's session record (BINARY)
+
+  static char levelToChar(uint8_t level);
+  static uint32_t buildId();
+
 private:
-  const char levelToChar(Level level);
-  void writeMessage(Level level, const char* message);
-  void writeHeader(uint8_t day, uint8_t month, uint8_t year);
+  static void onTask(void* arg);
+  static uint32_t hash(uint8_t level, const uint8_t* data, size_t len);
+
+  bool append(const uint8_t* data, size_t len);
+  void writeBuffer();
+  bool writeMessage(Level level, const char* message);
+  size_t writeHeader(char* out, uint8_t day, uint8_t month, uint8_t year);
+  size_t packRecord(uint8_t* record, uint8_t level, const char* format, const char* pattern, va_list args);
+  void writeRepeats();
+  void loadGeneration();
+  bool saveGeneration();
 
-  File _logFile;
+  StorageFile _logFile;   // framed in BINARY format
+  Format _format;
+  uint32_t _generation;
+  size_t _session;
   uint8_t _day;
   uint8_t _month;
   uint8_t _year;
+
+  uint8_t _buffer[EVENT_BUFFER_SIZE];
+  size_t _used;
+  unsigned long _bufferSince;
+  size_t _flushThreshold;
+  uint32_t _flushDelay;
+  int8_t _task;
+
+  uint32_t _lastHash;
+  uint16_t _repeats;
+  uint32_t _dropped;
+  uint32_t _coalesced;
+};
+
+// Renders a binary event log in the text format. Messages from another
+// firmware build can't be formatted and are shown as their raw arguments.
+class EventReader
+{
+public:
+  // Renders the records starting within [from, to) of the binary file; `from`
+  // must be a record boundary. Records from `session` on were written by this
+  // build (EventLog::session()), so reading from there seeks straight to
+  // `from`. An earlier `from` reads the sessions before it to know which
+  // build wrote what.
+  EventReader(const char* path, size_t from = 0, size_t to = SIZE_MAX, size_t session = SIZE_MAX);
+
+  size_t read(uint8_t* buffer, size_t len);
+
+private:
+  bool nextLine();
+  size_t renderRecord(char* out, size_t size, const uint8_t* record, size_t argLen);
+
+  File _file;
+  size_t _from;
+  size_t _to;
+  bool _known;
+  uint8_t _day;
+  uint8_t _month;
+  uint8_t _year;
+
+  char _line[EVENT_LINE_SIZE];
+  size_t _linePos;
+  size_t _lineLen;
 };
 
 extern EventLog _events;
-extern const char _eventlog_path[];
 
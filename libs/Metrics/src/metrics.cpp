@@ -0,0 +1,105 @@
+/*
+  Metrics - Lightweight runtime metrics for Arduino projects.
+  Copyright (c) 2025 gadefoxren@gmail.com
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "metrics.h"
+
+#if METRICS_ENABLED
+
+Metric* Metric::_first;   // zero before any constructor runs
+
+Metric::Metric(const char* name, const char* help, Type type)
+{
+  _name = name;
+  _help = help;
+  _type = type;
+
+  // Appended, so they come out in definition order within a file
+  _next = nullptr;
+  Metric** link = &_first;
+  while (*link)
+    link = &(*link)->_next;
+  *link = this;
+}
+
+void Metric::writeHeader(Print& out, const char* type) const
+{
+  out.printf("# HELP %s %s\n# TYPE %s %s\n", _name, _help, _name, type);
+}
+
+// Cycles as seconds with nanosecond digits, without floating point
+static void writeSeconds(Print& out, uint64_t cycles)
+{
+  uint64_t nanos = cycles * 1000 / (F_CPU / 1000000);
+  out.printf("%lu.%09lu", (unsigned long)(nanos / 1000000000), (unsigned long)(nanos % 1000000000));
+}
+
+void Metric::write(Print& out)
+{
+  for (Metric* metric = _first; metric; metric = metric->_next) {
+    switch (metric->_type) {
+      case COUNTER:
+        static_cast<Counter*>(metric)->write(out);
+        break;
+      case GAUGE:
+        static_cast<Gauge*>(metric)->write(out);
+        break;
+      case HISTOGRAM:
+        static_cast<Histogram*>(metric)->write(out);
+        break;
+    }
+  }
+}
+
+void Counter::write(Print& out) const
+{
+  writeHeader(out, "counter");
+  out.printf("%s %lu\n", _name, (unsigned long)value());
+}
+
+void Gauge::write(Print& out) const
+{
+  writeHeader(out, "gauge");
+  out.printf("%s %ld\n", _name, (long)(_read ? _read() : _value));
+}
+
+void Histogram::write(Print& out) const
+{
+  uint32_t count = 0;
+
+  writeHeader(out, "histogram");
+  for (uint8_t bucket = 0; bucket < METRICS_BUCKETS; bucket++) {
+    count += _buckets[bucket];
+    out.printf("%s_bucket{le=\"", _name);
+    if (bucket == METRICS_BUCKETS - 1)
+      out.print("+Inf");
+    else
+      writeSeconds(out, 1ULL << (METRICS_FIRST_BOUND + 2 * bucket));
+    out.printf("\"} %lu\n", (unsigned long)count);
+  }
+
+  out.printf("%s_sum ", _name);
+  writeSeconds(out, _sum);
+  out.printf("\n%s_count %lu\n", _name, (unsigned long)count);
+
+  // The worst case, which the buckets only bound
+  out.printf("# TYPE %s_max gauge\n%s_max ", _name, _name);
+  writeSeconds(out, _max);
+  out.print("\n");
+}
+
+#endif
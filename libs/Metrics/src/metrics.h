@@ -0,0 +1,169 @@
+/*
+  Metrics - Lightweight runtime metrics for Arduino projects.
+  Copyright (c) 2025 gadefoxren@gmail.com
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+// Build with -DMETRICS_ENABLED=0 (e.g. --build-property compiler.cpp.extra_flags=...)
+// to turn every metric into an empty inline no-op
+#ifndef METRICS_ENABLED
+#define METRICS_ENABLED 1
+#endif
+
+#define METRICS_BUCKETS      10   // histogram buckets, the last one +Inf
+#define METRICS_FIRST_BOUND  6    // first bucket bound: 2^6 CPU cycles; each next one is 4x
+
+#if METRICS_ENABLED
+
+// Metrics register themselves on construction; define them as globals
+class Metric
+{
+public:
+  enum Type { COUNTER, GAUGE, HISTOGRAM };
+
+  static void write(Print& out);   // All metrics in the Prometheus text format
+
+protected:
+  Metric(const char* name, const char* help, Type type);
+
+  void writeHeader(Print& out, const char* type) const;
+
+  const char* _name;
+  const char* _help;
+  Type _type;
+  Metric* _next;
+
+  static Metric* _first;
+};
+
+// Added to by the code, or read at scrape time from a function that returns
+// a running total
+class Counter : public Metric
+{
+public:
+  Counter(const char* name, const char* help, uint32_t (*read)() = nullptr) : Metric(name, help, COUNTER), _value(0), _read(read) {}
+
+  inline void add(uint32_t n = 1) { _value += n; }
+  inline uint32_t value() const { return _read ? _read() : _value; }
+
+  void write(Print& out) const;
+
+private:
+  uint32_t _value;
+  uint32_t (*_read)();
+};
+
+// Set by the code, or read at scrape time from a function
+class Gauge : public Metric
+{
+public:
+  Gauge(const char* name, const char* help, int32_t (*read)() = nullptr) : Metric(name, help, GAUGE), _value(0), _read(read) {}
+
+  inline void set(int32_t value) { _value = value; }
+
+  void write(Print& out) const;
+
+private:
+  int32_t _value;
+  int32_t (*_read)();
+};
+
+// Latencies in CPU cycles, bucketed by powers of 4 and written in seconds
+class Histogram : public Metric
+{
+public:
+  Histogram(const char* name, const char* help) : Metric(name, help, HISTOGRAM), _buckets(), _sum(0), _max(0) {}
+
+  inline void record(uint32_t cycles)
+  {
+    // Smallest bound not below cycles: bits of (cycles - 1), rounded up to an even power
+    uint8_t bucket = 0;
+    if (cycles > (1u << METRICS_FIRST_BOUND)) {
+      uint8_t bits = 32 - __builtin_clz(cycles - 1);
+      bucket = (bits - METRICS_FIRST_BOUND + 1) / 2;
+      if (bucket >= METRICS_BUCKETS)
+        bucket = METRICS_BUCKETS - 1;
+    }
+
+    _buckets[bucket]++;
+    _sum += cycles;
+    if (cycles > _max)
+      _max = cycles;
+  }
+
+  inline uint32_t max() const { return _max; }   // Worst case, in cycles
+
+  void write(Print& out) const;
+
+private:
+  uint32_t _buckets[METRICS_BUCKETS];
+  uint64_t _sum;
+  uint32_t _max;
+};
+
+// Times its scope into a histogram
+class MetricTimer
+{
+public:
+  inline explicit MetricTimer(Histogram& histogram) : _histogram(histogram), _start(ESP.getCycleCount()) {}
+  inline ~MetricTimer() { _histogram.record(ESP.getCycleCount() - _start); }
+
+private:
+  Histogram& _histogram;
+  uint32_t _start;
+};
+
+#else
+
+class Metric
+{
+public:
+  static inline void write(Print&) {}
+};
+
+class Counter
+{
+public:
+  constexpr Counter(const char*, const char*, uint32_t (*)() = nullptr) {}
+  inline void add(uint32_t = 1) {}
+  inline uint32_t value() const { return 0; }
+};
+
+class Gauge
+{
+public:
+  constexpr Gauge(const char*, const char*, int32_t (*)() = nullptr) {}
+  inline void set(int32_t) {}
+};
+
+class Histogram
+{
+public:
+  constexpr Histogram(const char*, const char*) {}
+  inline void record(uint32_t) {}
+  inline uint32_t max() const { return 0; }
+};
+
+class MetricTimer
+{
+public:
+  inline explicit MetricTimer(Histogram&) {}
+};
+
+#endif
@@ -0,0 +1,200 @@
+/*
+  Scheduler - Cooperative task scheduler for Arduino projects.
+  Copyright (c) 2025 gadefoxren@gmail.com
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "scheduler.h"
+
+static_assert(SCHEDULER_MAX_TASKS <= 32, "Scheduler::_batch holds one bit per task");
+static_assert(SCHEDULER_MAX_TASKS < SCHEDULER_NONE, "Task ids must not collide with SCHEDULER_NONE");
+
+#define LEVEL_SHIFT(level) (SCHEDULER_WHEEL_BITS * (level))
+#define SLOT_MASK          (SCHEDULER_SLOTS - 1)
+
+// Global implementation
+Scheduler _scheduler;
+
+// Class implementation
+Scheduler::Scheduler()
+{
+  _count = 0;
+  _now = 0;
+  _batch = 0;
+  memset(_wheel, SCHEDULER_NONE, sizeof(_wheel));
+}
+
+int8_t Scheduler::add(const char* name, void (*callback)(void*), void* arg, uint32_t periodMs)
+{
+  if (_count == SCHEDULER_MAX_TASKS)
+    return -1;
+
+  SchedulerTask& task = _tasks[_count];
+  task = {};
+  task.name = name;
+  task.callback = callback;
+  task.arg = arg;
+  task.periodMs = periodMs;
+  task.level = SCHEDULER_NONE;
+  return _count++;
+}
+
+int8_t Scheduler::every(const char* name, uint32_t periodMs, void (*callback)(void*), void* arg)
+{
+  int8_t id = add(name, callback, arg, periodMs);
+  wake(id);
+  return id;
+}
+
+void Scheduler::wake(int8_t id, uint32_t delayMs)
+{
+  if (id < 0)
+    return;
+
+  stop(id);
+  _tasks[id].due = millis() + delayMs;
+  insert(id);
+}
+
+void Scheduler::stop(int8_t id)
+{
+  if (id < 0)
+    return;
+
+  _batch &= ~(1UL << id);
+  if (_tasks[id].level != SCHEDULER_NONE)
+    unlink(id);
+}
+
+// Level 0 holds what is due within 64 ms, level n what is due within 64^(n+1) ms.
+// Tasks further out than the whole wheel park in the last top-level slot and
+// are placed again when it cascades.
+void Scheduler::insert(uint8_t id)
+{
+  SchedulerTask& task = _tasks[id];
+  int32_t delta = task.due - _now;
+  uint32_t slotTime = task.due;
+  uint8_t level = 0;
+
+  if (delta < 0) {
+    task.due = _now;
+    delta = 0;
+  }
+
+  while (level < SCHEDULER_LEVELS - 1 && (uint32_t)delta >> LEVEL_SHIFT(level + 1))
+    level++;
+
+  if ((uint32_t)delta >> LEVEL_SHIFT(SCHEDULER_LEVELS - 1) >= SCHEDULER_SLOTS)
+    slotTime = _now + ((uint32_t)SLOT_MASK << LEVEL_SHIFT(level));
+
+  task.level = level;
+  task.slot = (slotTime >> LEVEL_SHIFT(level)) & SLOT_MASK;
+  task.next = _wheel[level][task.slot];
+  _wheel[level][task.slot] = id;
+}
+
+void Scheduler::unlink(uint8_t id)
+{
+  SchedulerTask& task = _tasks[id];
+  uint8_t* link = &_wheel[task.level][task.slot];
+
+  while (*link != id)
+    link = &_tasks[*link].next;
+
+  *link = task.next;
+  task.level = SCHEDULER_NONE;
+}
+
+// Move one slot of a higher level down now that its time range has come up
+void Scheduler::cascade(uint8_t level, uint8_t slot)
+{
+  uint8_t id = _wheel[level][slot];
+  _wheel[level][slot] = SCHEDULER_NONE;
+
+  while (id != SCHEDULER_NONE) {
+    uint8_t next = _tasks[id].next;
+    insert(id);
+    id = next;
+  }
+}
+
+uint32_t Scheduler::run()
+{
+  uint32_t target = millis();
+
+  while ((int32_t)(target - _now) >= 0) {
+    uint32_t now = _now;
+
+    for (uint8_t level = SCHEDULER_LEVELS - 1; level > 0; level--) {
+      if ((now & ((1UL << LEVEL_SHIFT(level)) - 1)) == 0)
+        cascade(level, (now >> LEVEL_SHIFT(level)) & SLOT_MASK);
+    }
+
+    // Take the slot first: callbacks may arm, stop or re-arm any task
+    uint8_t id = _wheel[0][now & SLOT_MASK];
+    _wheel[0][now & SLOT_MASK] = SCHEDULER_NONE;
+    for (; id != SCHEDULER_NONE; id = _tasks[id].next) {
+      _tasks[id].level = SCHEDULER_NONE;
+      _batch |= 1UL << id;
+    }
+
+    _now = now + 1;
+    for (id = 0; _batch; id++) {
+      if (_batch & (1UL << id)) {
+        _batch &= ~(1UL << id);
+        execute(id);
+      }
+    }
+  }
+
+  return idle();
+}
+
+void Scheduler::execute(uint8_t id)
+{
+  SchedulerTask& task = _tasks[id];
+
+  // Re-arm before the callback so it can stop itself. Runs missed while
+  // loop() was busy are skipped rather than caught up.
+  if (task.periodMs) {
+    task.due += task.periodMs;
+    if ((int32_t)(task.due - _now) < 0)
+      task.due = _now - 1 + task.periodMs;
+    insert(id);
+  }
+
+  uint32_t start = micros();
+  task.callback(task.arg);
+  uint32_t elapsed = micros() - start;
+
+  task.runs++;
+  if (elapsed > task.maxMicros)
+    task.maxMicros = elapsed;
+}
+
+// Up to the next armed level-0 slot, or to the end of this lap where a
+// cascade may bring more
+uint32_t Scheduler::idle() const
+{
+  uint32_t next = _now;
+
+  if (next & SLOT_MASK) {
+    while (_wheel[0][next & SLOT_MASK] == SCHEDULER_NONE && (++next & SLOT_MASK))
+      ;
+  }
+
+  int32_t wait = next - millis();
+  return wait > 0 ? wait : 0;
+}
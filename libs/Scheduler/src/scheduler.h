@@ -0,0 +1,83 @@
+/*
+  Scheduler - Cooperative task scheduler for Arduino projects.
+  Copyright (c) 2025 gadefoxren@gmail.com
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+#define SCHEDULER_MAX_TASKS  16
+#define SCHEDULER_WHEEL_BITS 6    // 64 slots per level
+#define SCHEDULER_LEVELS     4    // 1 ms, 64 ms, 4.1 s and 4.4 min slots; about 4.7 h ahead
+
+#define SCHEDULER_SLOTS      (1 << SCHEDULER_WHEEL_BITS)
+#define SCHEDULER_NONE       0xFF
+
+struct SchedulerTask {
+  const char* name;
+  void (*callback)(void* arg);
+  void* arg;
+  uint32_t periodMs;    // 0 for one-shot tasks
+  uint32_t due;         // millis() of the next run
+  uint32_t runs;
+  uint32_t maxMicros;   // longest single run
+  uint8_t next;         // next task in the same slot
+  uint8_t level;        // wheel level, SCHEDULER_NONE while not armed
+  uint8_t slot;
+};
+
+// Tasks live in a hierarchical timing wheel: level 0 holds the next 64 ms in
+// 1 ms slots, each level above covers 64 slots of the one below and is
+// cascaded down when the lower level wraps. Tasks due in the same
+// millisecond run in the order they were added.
+class Scheduler
+{
+public:
+  Scheduler();
+
+  // Registers a task without arming it. Returns its id, or -1 when full.
+  int8_t add(const char* name, void (*callback)(void*), void* arg, uint32_t periodMs = 0);
+
+  // Registers a periodic task that first runs right away
+  int8_t every(const char* name, uint32_t periodMs, void (*callback)(void*), void* arg);
+
+  void wake(int8_t id, uint32_t delayMs = 0);   // (Re)arm: run after delayMs, then every periodMs
+  void stop(int8_t id);                         // Disarm until the next wake()
+
+  // Runs what is due and returns the ms until something may be due again
+  uint32_t run();
+
+  inline uint8_t count() const { return _count; }
+  inline const SchedulerTask& task(uint8_t id) const { return _tasks[id]; }
+  inline bool armed(int8_t id) const { return id >= 0 && _tasks[id].level != SCHEDULER_NONE; }
+
+private:
+  void insert(uint8_t id);
+  void unlink(uint8_t id);
+  void cascade(uint8_t level, uint8_t slot);
+  void execute(uint8_t id);
+  uint32_t idle() const;
+
+  SchedulerTask _tasks[SCHEDULER_MAX_TASKS];
+  uint8_t _count;
+
+  uint8_t _wheel[SCHEDULER_LEVELS][SCHEDULER_SLOTS];   // first task per slot
+  uint32_t _now;                                      // next millisecond to process
+  uint32_t _batch;                                    // tasks taken from the current slot, not run yet
+};
+
+extern Scheduler _scheduler;
@@ -0,0 +1,209 @@
+/*
+  Storage - Framed append-only files on LittleFS.
+  Copyright (c) 2025 gadefoxren@gmail.com
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <LittleFS.h>
+#include <metrics.h>
+
+#include "storage.h"
+
+// Global implementation
+Storage _storage;
+
+static Counter _commitsTotal("elmer_storage_commits_total", "File commits");
+static Counter _recoveredBytes("elmer_storage_recovered_bytes_total", "Torn bytes cut off when a file was opened");
+
+// CRC-32 (IEEE) a nibble at a time; the same values as logcodec::crc32
+static const uint32_t _crcTable[16] = {
+  0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+  0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+uint32_t Storage::crc32(const uint8_t* data, size_t len, uint32_t crc)
+{
+  crc = ~crc;
+  while (len--) {
+    crc = _crcTable[(crc ^ *data) & 0x0F] ^ (crc >> 4);
+    crc = _crcTable[(crc ^ (*data++ >> 4)) & 0x0F] ^ (crc >> 4);
+  }
+  return ~crc;
+}
+
+// Storage
+Storage::Storage()
+{
+  _first = nullptr;
+}
+
+void Storage::attach(StorageFile* file)
+{
+  file->_next = _first;
+  _first = file;
+}
+
+void Storage::detach(StorageFile* file)
+{
+  for (StorageFile** link = &_first; *link; link = &(*link)->_next) {
+    if (*link == file) {
+      *link = file->_next;
+      return;
+    }
+  }
+}
+
+void Storage::sync()
+{
+  for (StorageFile* file = _first; file; file = file->_next)
+    file->commit();
+}
+
+// StorageFile
+StorageFile::StorageFile()
+{
+  _framing = nullptr;
+  _size = 0;
+  _committed = 0;
+  _recovered = 0;
+  _crc = 0;
+  _chunk = 0;
+  _next = nullptr;
+}
+
+StorageFile::~StorageFile()
+{
+  close();
+}
+
+bool StorageFile::open(const char* path, const StorageFraming* framing)
+{
+  close();
+
+  _framing = framing;
+  _recovered = 0;
+  if (framing)
+    recover(path);
+
+  _file = LittleFS.open(path, "a");
+  if (!_file)
+    return false;
+
+  _size = _file.size();
+  _committed = _size;
+  _crc = 0;
+  _chunk = 0;
+  _storage.attach(this);
+  return true;
+}
+
+void StorageFile::close()
+{
+  if (!_file)
+    return;
+
+  commit();
+  _file.close();
+  _storage.detach(this);
+}
+
+size_t StorageFile::write(const uint8_t* data, size_t len)
+{
+  if (!_file)
+    return 0;
+
+  size_t written = _file.write(data, len);
+  if (_framing) {
+    _crc = Storage::crc32(data, written, _crc);
+    _chunk += written;
+  }
+  _size += written;
+  return written;
+}
+
+// A durability point: the chunk gets its frame, then LittleFS commits.
+// Callers commit between records, so the frame never splits one.
+void StorageFile::commit()
+{
+  if (!_file)
+    return;
+
+  frame();
+  if (_size == _committed)
+    return;
+
+  _file.flush();
+  _committed = _size;
+  _commitsTotal.add(1);
+}
+
+void StorageFile::frame()
+{
+  uint8_t out[STORAGE_FRAME_MAX];
+
+  if (!_framing || _chunk == 0)
+    return;
+
+  _framing->encode(out, _chunk, _crc);
+  _size += _file.write(out, _framing->size);
+  _crc = 0;
+  _chunk = 0;
+}
+
+// Whatever precedes the last frame that checks out was written whole, so a
+// torn write can only have left part of one chunk, and its frame, behind it.
+// A file without any frame near its end is left alone: it may predate framing.
+void StorageFile::recover(const char* path)
+{
+  File file = LittleFS.open(path, "r");
+  if (!file)
+    return;
+
+  size_t size = file.size();
+  if (size == 0)
+    return;
+
+  size_t window = 2 * (STORAGE_MAX_CHUNK + _framing->size);
+  size_t start = size > window ? size - window : 0;
+
+  uint8_t* tail = new uint8_t[size - start];
+  if (!tail)
+    return;
+
+  bool ok = file.seek(start) && (size_t)file.read(tail, size - start) == size - start;
+  file.close();
+
+  // Frames end at most one chunk and frame before the end of the file
+  size_t end = size, last = size > (size_t)STORAGE_MAX_CHUNK + _framing->size ? size - STORAGE_MAX_CHUNK - _framing->size : 0;
+  for (; ok && end >= last && end >= start + _framing->size; end--) {
+    size_t at = end - start - _framing->size;
+    uint32_t len, crc;
+
+    if (!_framing->decode(tail + at, len, crc) || len > STORAGE_MAX_CHUNK || len > at)
+      continue;
+    if (Storage::crc32(tail + at - len, len) == crc)
+      break;
+  }
+  delete[] tail;
+
+  if (!ok || end < last || end < start + _framing->size || end == size)
+    return;
+
+  file = LittleFS.open(path, "r+");
+  if (file && file.truncate(end)) {
+    _recovered = size - end;
+    _recoveredBytes.add(_recovered);
+  }
+}
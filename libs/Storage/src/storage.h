@@ -0,0 +1,98 @@
+/*
+  Storage - Framed append-only files on LittleFS.
+  Copyright (c) 2025 gadefoxren@gmail.com
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+
+#define STORAGE_MAX_CHUNK   2048   // most bytes written between two commits of a framed file
+#define STORAGE_FRAME_MAX   16
+
+// A frame closes each chunk of a framed file with the chunk's length and
+// CRC-32. Its encoding belongs to the file format, so the format's readers
+// skip it as one of their own records.
+struct StorageFraming {
+  uint8_t size;   // bytes of an encoded frame, at most STORAGE_FRAME_MAX
+  void (*encode)(uint8_t* out, uint32_t len, uint32_t crc);
+  bool (*decode)(const uint8_t* frame, uint32_t& len, uint32_t& crc);   // false: not a frame
+};
+
+// An append-only file whose durability points are explicit: write() goes to
+// LittleFS, commit() makes everything written so far durable with one
+// flush. Nothing is merged here: callers batch records in RAM and commit
+// whole batches.
+//
+// A framed file gets a frame at every commit(), which callers issue between
+// records and at least every STORAGE_MAX_CHUNK bytes. Opening it again
+// checks the last frame and cuts off a torn tail behind it, which can only
+// be the chunk that was being written.
+class StorageFile
+{
+public:
+  StorageFile();
+  ~StorageFile();
+
+  bool open(const char* path, const StorageFraming* framing = nullptr);
+  void close();   // Commits first
+
+  size_t write(const uint8_t* data, size_t len);
+  void commit();
+
+  inline size_t size() const { return _size; }
+  inline size_t committed() const { return _committed; }   // Durable bytes; what other readers see
+  inline uint32_t recovered() const { return _recovered; } // Torn bytes dropped by open()
+  inline operator bool() const { return (bool)_file; }
+
+private:
+  friend class Storage;
+
+  void frame();
+  void recover(const char* path);
+
+  File _file;
+  const StorageFraming* _framing;
+  size_t _size;
+  size_t _committed;
+  uint32_t _recovered;
+
+  uint32_t _crc;            // of the chunk so far
+  uint32_t _chunk;          // bytes since the last frame
+
+  StorageFile* _next;       // open files
+};
+
+class Storage
+{
+public:
+  Storage();
+
+  void sync();     // Commits every open file, e.g. before a restart
+
+  static uint32_t crc32(const uint8_t* data, size_t len, uint32_t crc = 0);
+
+private:
+  friend class StorageFile;
+
+  void attach(StorageFile* file);
+  void detach(StorageFile* file);
+
+  StorageFile* _first;
+};
+
+extern Storage _storage;
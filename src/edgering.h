@@ -0,0 +1,57 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+
+struct Edge {
+  uint32_t micros;
+  uint8_t level;
+};
+
+// Single-producer/single-consumer ring of pin edges. push() runs in the ISR,
+// pop() in loop(); neither side blocks or disables interrupts.
+template <uint8_t Size>
+class EdgeRing
+{
+  static_assert(Size && (Size & (Size - 1)) == 0, "EdgeRing size must be a power of two");
+  static_assert(Size <= 128, "EdgeRing indices are 8 bits");
+
+public:
+  EdgeRing() : _head(0), _tail(0), _overflows(0) {}
+
+  // Forced inline so the ISR never calls into flash while the cache is disabled
+  __attribute__((always_inline)) inline bool push(uint32_t micros, uint8_t level)
+  {
+    uint8_t head = _head;
+    if ((uint8_t)(head - _tail) == Size) {
+      _overflows++;
+      return false;
+    }
+
+    _edges[head & (Size - 1)] = { micros, level };
+    std::atomic_signal_fence(std::memory_order_release);
+    _head = head + 1;
+    return true;
+  }
+
+  inline bool pop(Edge& edge)
+  {
+    uint8_t tail = _tail;
+    if (tail == _head)
+      return false;
+
+    std::atomic_signal_fence(std::memory_order_acquire);
+    edge = _edges[tail & (Size - 1)];
+    std::atomic_signal_fence(std::memory_order_release);
+    _tail = tail + 1;
+    return true;
+  }
+
+  inline uint16_t overflows() const { return _overflows; }
+
+private:
+  Edge _edges[Size];
+  volatile uint8_t _head;
+  volatile uint8_t _tail;
+  volatile uint16_t _overflows;
+};
@@ -0,0 +1,140 @@
+#include <metrics.h>
+#include <scheduler.h>
+
+#include "global.h"
+#include "livefeed.h"
+
+static Counter _dropped("elmer_live_dropped_batches_total", "Live batches a slow client never got");
+static Counter _frames("elmer_live_frames_total", "Live frames sent");
+
+static char _frame[LIVE_BATCHES * LIVE_BATCH_SIZE];   // pending batches of one client
+
+LiveFeed::LiveFeed()
+{
+  memset(_lengths, 0, sizeof(_lengths));
+  memset(_clients, 0, sizeof(_clients));
+  _head = 0;
+  _closedTime = 0;
+  _task = -1;
+}
+
+void LiveFeed::begin(AsyncWebServer& server)
+{
+  _socket.onEvent([this](AsyncWebSocket* socket, AsyncWebSocketClient* client, AwsEventType type,
+                         void* arg, uint8_t* data, size_t len) {
+      onEvent(client, type);
+  });
+  server.addHandler(&_socket);
+
+  if (_task < 0)
+    _task = _scheduler.add("live", onTask, this, LIVE_PERIOD_MS);
+  start();
+}
+
+// The task polls for clients every period, since the async TCP context
+// that accepts them can't arm it
+void LiveFeed::start()
+{
+  _scheduler.wake(_task);
+}
+
+void LiveFeed::end()
+{
+  _socket.closeAll();
+  _scheduler.stop(_task);
+}
+
+void LiveFeed::onTask(void* arg)
+{
+  static_cast<LiveFeed*>(arg)->update();
+}
+
+// Runs in the async TCP context: only the cursor table changes here, the
+// scheduler is left alone. The next update() picks a new client up.
+void LiveFeed::onEvent(AsyncWebSocketClient* client, AwsEventType type)
+{
+  if (type == WS_EVT_DISCONNECT) {
+    for (Client& state : _clients) {
+      if (state.id == client->id())
+        state.id = 0;
+    }
+    return;
+  }
+
+  if (type != WS_EVT_CONNECT)
+    return;
+
+  for (Client& state : _clients) {
+    if (state.id == 0) {
+      // Start with the latest batch rather than a blank screen
+      state.next = _head ? _head - 1 : 0;
+      state.id = client->id();
+      return;
+    }
+  }
+
+  client->close();
+}
+
+void LiveFeed::update()
+{
+  _socket.cleanupClients(LIVE_MAX_CLIENTS);
+  if (_socket.count() == 0)
+    return;
+
+  format();
+
+  for (Client& state : _clients) {
+    if (state.id == 0)
+      continue;
+
+    AsyncWebSocketClient* client = _socket.client(state.id);
+    if (!client) {
+      state.id = 0;
+      continue;
+    }
+
+    // A client whose last frame is still queued waits, and falls behind
+    if (client->queueLen() == 0)
+      send(client, state);
+  }
+}
+
+// The batch is formatted once, however many clients read it
+void LiveFeed::format()
+{
+  uint8_t slot = _head % LIVE_BATCHES;
+  char* out = _batches[slot];
+  int len = snprintf(out, LIVE_BATCH_SIZE, "{\"t\":%lu,\"w\":%.1f,\"n\":%u,\"us\":%lu}\n",
+                     (unsigned long)time(nullptr), _sensor.power(), _sensor.pulses(),
+                     (unsigned long)_sensor.pulseInterval());
+
+  if (_sensor.closedTime() != _closedTime) {
+    _closedTime = _sensor.closedTime();
+    len += snprintf(out + len, LIVE_BATCH_SIZE - len, "{\"interval\":%lu,\"count\":%u}\n",
+                    (unsigned long)_closedTime, _sensor.closedCount());
+  }
+
+  _lengths[slot] = len < LIVE_BATCH_SIZE ? len : LIVE_BATCH_SIZE - 1;
+  _head++;
+}
+
+void LiveFeed::send(AsyncWebSocketClient* client, Client& state)
+{
+  if (_head - state.next > LIVE_BATCHES) {
+    _dropped.add(_head - LIVE_BATCHES - state.next);
+    state.next = _head - LIVE_BATCHES;
+  }
+
+  size_t len = 0;
+  for (; state.next != _head; state.next++) {
+    uint8_t slot = state.next % LIVE_BATCHES;
+    memcpy(_frame + len, _batches[slot], _lengths[slot]);
+    len += _lengths[slot];
+  }
+
+  if (len) {
+    client->text(_frame, len);
+    _frames.add();
+  }
+}
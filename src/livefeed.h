@@ -0,0 +1,51 @@
+#pragma once
+
+#include <ESPAsyncWebServer.h>
+
+#define LIVE_PERIOD_MS    500   // one batch per period while clients are connected, else a poll for them
+#define LIVE_BATCHES      8     // batches kept for clients that fall behind
+#define LIVE_BATCH_SIZE   128   // bytes of one formatted batch
+#define LIVE_MAX_CLIENTS  4
+
+// Pushes sensor readings to WebSocket clients on /live. Every period the
+// feed formats one batch, a line of JSON per event, into a ring shared by
+// all clients, which only keep a cursor into it:
+//
+//   {"t":<epoch>,"w":<watts>,"n":<pulses this interval>,"us":<last pulse interval>}
+//   {"interval":<epoch>,"count":<pulses>}      when an interval closed, stamped with its end
+//
+// A client gets everything it has not seen as one frame once its previous
+// frames have been sent; one that falls more than LIVE_BATCHES behind loses
+// the oldest batches, so slow clients cost no heap beyond their socket.
+class LiveFeed
+{
+public:
+  LiveFeed();
+
+  void begin(AsyncWebServer& server);   // Starts too
+  void start();                         // Serve clients again after end()
+  void end();                           // Close all clients
+
+private:
+  struct Client {
+    uint32_t id;      // 0: free
+    uint32_t next;    // sequence number of the first batch not sent yet
+  };
+
+  static void onTask(void* arg);
+  void onEvent(AsyncWebSocketClient* client, AwsEventType type);
+
+  void update();
+  void format();
+  void send(AsyncWebSocketClient* client, Client& state);
+
+  AsyncWebSocket _socket {"/live"};
+
+  char _batches[LIVE_BATCHES][LIVE_BATCH_SIZE];
+  uint8_t _lengths[LIVE_BATCHES];
+  uint32_t _head;         // sequence number of the next batch
+  uint32_t _closedTime;   // last closed interval formatted
+
+  Client _clients[LIVE_MAX_CLIENTS];
+  int8_t _task;
+};
@@ -0,0 +1,506 @@
+#pragma once
+
+// Sensor log format v2, shared by the firmware and host tools (no Arduino deps).
+//
+// A log is a byte stream of records. Each record starts with a varint `v`:
+//
+//   v != 0   interval entry: offset delta = v >> 3 (>= 1), the low 3 bits hold
+//            the zig-zag encoded pulse difference to the previous entry, or 7
+//            when the difference follows as its own varint
+//   v == 0   escape, followed by a tag byte:
+//              LOG_TAG_HEADER    rest of the 8-byte LogHeader
+//              LOG_TAG_MARKER    varint timestamp; offsets and pulses restart
+//              LOG_TAG_CHANNELS  varint offset delta, varint channel mask,
+//                                then a varint count per channel in the mask
+//              LOG_TAG_FRAME     16-bit length and CRC-32 (little endian) of
+//                                the bytes since the previous frame; written
+//                                by the storage layer at each commit
+//
+// Intervals without pulses are not stored; the offset delta skips them.
+//
+// A pulse capture (Sensor::startCapture) is a CaptureHeader followed by a
+// varint per pulse: the microseconds since the previous pulse, or since the
+// capture started for the first one.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define LOG_VERSION       2
+#define LOG_MAX_RECORD    8     // worst-case bytes of one encoded record
+
+#define LOG_TAG_MARKER    0x01
+#define LOG_TAG_CHANNELS  0x02
+#define LOG_TAG_FRAME     0x03
+#define LOG_TAG_HEADER    'E'
+
+#define LOG_MAX_CHANNELS  16
+#define LOG_MAX_CHANNEL_RECORD (2 + 5 + 3 + 3 * LOG_MAX_CHANNELS)   // worst-case channel record
+
+#define LOG_FRAME_SIZE    8     // escape, tag, length(2), CRC-32(4)
+
+#define LOG_PULSES_INLINE 7     // low-bit value meaning "pulse difference follows"
+
+struct LogHeader {
+  uint8_t magic[4];       // "\0ELM"
+  uint8_t version;
+  uint8_t flags;
+  uint8_t intervalSec[2]; // little endian
+};
+
+static_assert(sizeof(LogHeader) == 8, "LogHeader must stay 8 bytes");
+
+struct CaptureHeader {
+  uint8_t magic[4];         // "ECAP"
+  uint32_t startTime;       // epoch seconds, 0 if the clock was not set yet
+  uint16_t impulsesPerKWh;
+  uint16_t seconds;         // requested length
+  uint8_t capture;          // Sensor::Capture; POLLING times are good to SENSOR_POLL_MS
+  uint8_t reserved[3];
+};
+
+static_assert(sizeof(CaptureHeader) == 16, "CaptureHeader must stay 16 bytes");
+
+struct LogRecord {
+  enum Type { INVALID, HEADER, MARKER, ENTRY, CHANNELS, FRAME };
+
+  Type type;
+  uint32_t timestamp;     // HEADER/MARKER: segment start; ENTRY/CHANNELS: interval time
+  uint32_t offset;        // ENTRY/CHANNELS: intervals since the marker
+  uint16_t pulses;        // ENTRY
+  uint16_t mask;          // CHANNELS: channels with pulses
+  uint16_t counts[LOG_MAX_CHANNELS];  // CHANNELS: by channel number
+};
+
+namespace logcodec {
+
+inline size_t putVarint(uint8_t* out, uint32_t value)
+{
+  size_t len = 0;
+  while (value >= 0x80) {
+    out[len++] = (uint8_t)value | 0x80;
+    value >>= 7;
+  }
+  out[len++] = (uint8_t)value;
+  return len;
+}
+
+// Returns bytes consumed, or 0 when the varint is truncated or too long
+inline size_t getVarint(const uint8_t* data, size_t len, uint32_t& value)
+{
+  uint32_t result = 0;
+  for (size_t i = 0; i < len && i < 5; i++) {
+    result |= (uint32_t)(data[i] & 0x7F) << (7 * i);
+    if (!(data[i] & 0x80)) {
+      value = result;
+      return i + 1;
+    }
+  }
+  return 0;
+}
+
+inline uint32_t zigzag(int32_t value) { return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31); }
+inline int32_t unzigzag(uint32_t value) { return (int32_t)(value >> 1) ^ -(int32_t)(value & 1); }
+
+// CRC-32 (IEEE), bitwise: small and only used on short buffers
+inline uint32_t crc32(const uint8_t* data, size_t len, uint32_t crc = 0)
+{
+  crc = ~crc;
+  while (len--) {
+    crc ^= *data++;
+    for (int bit = 0; bit < 8; bit++)
+      crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+  }
+  return ~crc;
+}
+
+// True when all eight bytes of w are one-byte entries: nonzero, without a
+// continuation bit and with the pulse difference inline (low bits not 7)
+inline bool shortEntries(uint64_t w)
+{
+  const uint64_t ones = 0x0101010101010101ULL, highs = ones << 7, sevens = ones * LOG_PULSES_INLINE;
+  uint64_t escaped = (w & sevens) ^ sevens;
+
+  return !(w & highs) && !((w - ones) & ~w & highs) && !((escaped - ones) & ~escaped & highs);
+}
+
+inline bool isHeader(const uint8_t* data, size_t len)
+{
+  return len >= sizeof(LogHeader) && data[0] == 0 && data[1] == LOG_TAG_HEADER &&
+         data[2] == 'L' && data[3] == 'M' && data[4] == LOG_VERSION;
+}
+
+// A frame's chunk length and CRC; false for anything else
+inline bool getFrame(const uint8_t* data, uint32_t& len, uint32_t& crc)
+{
+  if (data[0] != 0 || data[1] != LOG_TAG_FRAME)
+    return false;
+
+  len = data[2] | data[3] << 8;
+  crc = (uint32_t)data[4] | (uint32_t)data[5] << 8 | (uint32_t)data[6] << 16 | (uint32_t)data[7] << 24;
+  return true;
+}
+
+inline bool isCapture(const uint8_t* data, size_t len)
+{
+  return len >= sizeof(CaptureHeader) && !memcmp(data, "ECAP", 4);
+}
+
+}  // namespace logcodec
+
+class LogEncoder
+{
+public:
+  LogEncoder() { reset(); }
+
+  inline void reset()
+  {
+    _offset = 0;
+    _pulses = 0;
+  }
+
+  // Continue after entries encoded before a restart
+  inline void resume(uint32_t offset, uint16_t pulses)
+  {
+    _offset = offset;
+    _pulses = pulses;
+  }
+
+  inline uint32_t offset() const { return _offset; }
+  inline uint16_t pulses() const { return _pulses; }
+
+  static size_t header(uint8_t* out, uint16_t intervalSec)
+  {
+    out[0] = 0;
+    out[1] = LOG_TAG_HEADER;
+    out[2] = 'L';
+    out[3] = 'M';
+    out[4] = LOG_VERSION;
+    out[5] = 0;
+    out[6] = (uint8_t)intervalSec;
+    out[7] = (uint8_t)(intervalSec >> 8);
+    return sizeof(LogHeader);
+  }
+
+  static void frame(uint8_t* out, uint32_t len, uint32_t crc)
+  {
+    out[0] = 0;
+    out[1] = LOG_TAG_FRAME;
+    out[2] = (uint8_t)len;
+    out[3] = (uint8_t)(len >> 8);
+    out[4] = (uint8_t)crc;
+    out[5] = (uint8_t)(crc >> 8);
+    out[6] = (uint8_t)(crc >> 16);
+    out[7] = (uint8_t)(crc >> 24);
+  }
+
+  // Start a segment: following offsets are relative to timestamp
+  size_t marker(uint8_t* out, uint32_t timestamp)
+  {
+    reset();
+    out[0] = 0;
+    out[1] = LOG_TAG_MARKER;
+    return 2 + logcodec::putVarint(out + 2, timestamp);
+  }
+
+  // Returns 0 for an empty interval, which is skipped
+  size_t entry(uint8_t* out, uint32_t offset, uint16_t pulses)
+  {
+    if (pulses == 0 || offset <= _offset)
+      return 0;
+
+    uint32_t diff = logcodec::zigzag((int32_t)pulses - (int32_t)_pulses);
+    uint32_t delta = offset - _offset;
+    size_t len;
+
+    _offset = offset;
+    _pulses = pulses;
+
+    if (diff < LOG_PULSES_INLINE)
+      return logcodec::putVarint(out, delta << 3 | diff);
+
+    len = logcodec::putVarint(out, delta << 3 | LOG_PULSES_INLINE);
+    return len + logcodec::putVarint(out + len, diff);
+  }
+
+  // One interval of several channels; only channels in mask are stored.
+  // Returns 0 when no channel has pulses.
+  size_t channels(uint8_t* out, uint32_t offset, uint16_t mask, const uint16_t* counts)
+  {
+    if (mask == 0 || offset <= _offset)
+      return 0;
+
+    size_t len = 2;
+    out[0] = 0;
+    out[1] = LOG_TAG_CHANNELS;
+    len += logcodec::putVarint(out + len, offset - _offset);
+    len += logcodec::putVarint(out + len, mask);
+    for (uint8_t channel = 0; mask; channel++, mask >>= 1) {
+      if (mask & 1)
+        len += logcodec::putVarint(out + len, counts[channel]);
+    }
+
+    _offset = offset;
+    return len;
+  }
+
+private:
+  uint32_t _offset;
+  uint16_t _pulses;
+};
+
+class LogDecoder
+{
+public:
+  LogDecoder() : _intervalSec(30), _timestamp(0), _offset(0), _pulses(0), _invalid(0) {}
+
+  inline uint16_t intervalSec() const { return _intervalSec; }
+  inline uint32_t invalid() const { return _invalid; }   // Bytes skipped by entries()
+
+  // Decodes one record from data. Returns bytes consumed, or 0 if the record
+  // is incomplete and more input is needed. Undecodable bytes are consumed
+  // one at a time as INVALID records so the caller can resynchronize.
+  size_t next(const uint8_t* data, size_t len, LogRecord& record)
+  {
+    uint32_t v, value;
+    size_t used, n;
+
+    used = logcodec::getVarint(data, len, v);
+    if (!used)
+      return invalid(len, 5, record);
+
+    if (v == 0) {
+      if (used == len)
+        return 0;
+
+      if (data[used] == LOG_TAG_MARKER) {
+        n = logcodec::getVarint(data + used + 1, len - used - 1, value);
+        if (!n)
+          return invalid(len - used - 1, 5, record);
+
+        _timestamp = value;
+        _offset = 0;
+        _pulses = 0;
+        record.type = LogRecord::MARKER;
+        record.timestamp = value;
+        return used + 1 + n;
+      }
+
+      if (data[used] == LOG_TAG_CHANNELS)
+        return channels(data, len, used + 1, record);
+
+      // Frames only matter to the storage layer
+      if (data[used] == LOG_TAG_FRAME) {
+        if (len < LOG_FRAME_SIZE)
+          return 0;
+
+        record.type = LogRecord::FRAME;
+        return LOG_FRAME_SIZE;
+      }
+
+      if (data[used] == LOG_TAG_HEADER) {
+        if (len < sizeof(LogHeader))
+          return 0;
+        if (!logcodec::isHeader(data, len))
+          return invalid(1, 0, record);
+
+        _intervalSec = data[6] | data[7] << 8;
+        record.type = LogRecord::HEADER;
+        record.timestamp = _timestamp;
+        return sizeof(LogHeader);
+      }
+
+      return invalid(1, 0, record);
+    }
+
+    value = v & LOG_PULSES_INLINE;
+    if (value == LOG_PULSES_INLINE) {
+      n = logcodec::getVarint(data + used, len - used, value);
+      if (!n)
+        return invalid(len - used, 5, record);
+      used += n;
+    }
+
+    _offset += v >> 3;
+    _pulses += logcodec::unzigzag(value);
+
+    record.type = LogRecord::ENTRY;
+    record.offset = _offset;
+    record.pulses = _pulses;
+    record.timestamp = _timestamp + _offset * _intervalSec;
+    return used;
+  }
+
+  // Decodes entries only, into parallel arrays, for bulk readers on the host.
+  // Runs of one-byte entries, the usual case, go eight at a time once a word
+  // test shows none of them needs the general path; other entries of up to
+  // two bytes are decoded inline, and only the rest goes through next().
+  // Stops when max entries are out or the input ends in an incomplete
+  // record; `used` tells how far it got.
+  //
+  // With a channels array, channel records come out as a row per channel in
+  // their mask and plain entries as channel 0; without one they are skipped.
+  size_t entries(const uint8_t* data, size_t len, uint32_t* timestamps, uint16_t* pulses, size_t max, size_t& used,
+                 uint8_t* channels = nullptr)
+  {
+    size_t count = 0, pos = 0, n;
+    LogRecord record;
+    uint64_t word;
+
+    // Locals, so stores to the outputs cannot force reloads of the state
+    uint32_t base = _timestamp, offset = _offset, interval = _intervalSec;
+    uint16_t value = _pulses;
+
+    while (count < max) {
+      if (len - pos >= 8 && max - count >= 8) {
+        memcpy(&word, data + pos, 8);
+        if (logcodec::shortEntries(word)) {
+          // Running sums of all eight lanes at once: multiplying by 0x0101..
+          // adds every byte into the ones above it. Pulse differences are
+          // biased by 3 to stay positive; no lane sum can carry over.
+          const uint64_t ones = 0x0101010101010101ULL;
+          uint64_t half = (word >> 1) & ones * 3, odd = word & ones;
+          uint64_t negative = (((ones * 0x82) - half) & ~(ones << 7)) & (odd * 0xFF);
+          uint64_t biased = ((half + ones * 3) & ~(odd * 0xFF)) | negative;
+          uint64_t offsets = ((word >> 3) & ones * 0x0F) * ones;
+          uint64_t sums = biased * ones;
+
+          for (size_t i = 0; i < 8; i++) {
+            timestamps[count + i] = base + (offset + (uint8_t)(offsets >> 8 * i)) * interval;
+            pulses[count + i] = value + (uint8_t)(sums >> 8 * i) - 3 * (i + 1);
+          }
+          if (channels)
+            memset(channels + count, 0, 8);
+          offset += offsets >> 56;
+          value += (sums >> 56) - 24;
+          count += 8;
+          pos += 8;
+          continue;
+        }
+      }
+
+      n = shortEntry(data + pos, len - pos, offset, value);
+      if (n) {
+        if (channels)
+          channels[count] = 0;
+        timestamps[count] = base + offset * interval;
+        pulses[count++] = value;
+        pos += n;
+        continue;
+      }
+
+      // A channel record needs room for all its rows
+      if (len - pos >= 2 && data[pos] == 0 && data[pos + 1] == LOG_TAG_CHANNELS && max - count < LOG_MAX_CHANNELS)
+        break;
+
+      _offset = offset;
+      _pulses = value;
+      n = next(data + pos, len - pos, record);
+      base = _timestamp;
+      offset = _offset;
+      interval = _intervalSec;
+      value = _pulses;
+      if (!n)
+        break;
+
+      pos += n;
+      if (record.type == LogRecord::ENTRY) {
+        if (channels)
+          channels[count] = 0;
+        timestamps[count] = record.timestamp;
+        pulses[count++] = record.pulses;
+      } else if (record.type == LogRecord::CHANNELS && channels) {
+        for (uint8_t channel = 0; channel < LOG_MAX_CHANNELS; channel++) {
+          if (!(record.mask & 1 << channel))
+            continue;
+
+          channels[count] = channel;
+          timestamps[count] = record.timestamp;
+          pulses[count++] = record.counts[channel];
+        }
+      } else if (record.type == LogRecord::INVALID)
+        _invalid++;
+    }
+
+    _offset = offset;
+    _pulses = value;
+    used = pos;
+    return count;
+  }
+
+private:
+  size_t channels(const uint8_t* data, size_t len, size_t used, LogRecord& record)
+  {
+    uint32_t delta, mask, count;
+    size_t n;
+
+    n = logcodec::getVarint(data + used, len - used, delta);
+    if (!n)
+      return invalid(len - used, 5, record);
+    used += n;
+
+    n = logcodec::getVarint(data + used, len - used, mask);
+    if (!n)
+      return invalid(len - used, 5, record);
+    used += n;
+
+    if (delta == 0 || mask >> LOG_MAX_CHANNELS)
+      return invalid(1, 0, record);
+
+    memset(record.counts, 0, sizeof(record.counts));
+    for (uint8_t channel = 0; channel < LOG_MAX_CHANNELS; channel++) {
+      if (!(mask & 1 << channel))
+        continue;
+
+      n = logcodec::getVarint(data + used, len - used, count);
+      if (!n)
+        return invalid(len - used, 5, record);
+      used += n;
+      record.counts[channel] = count;
+    }
+
+    _offset += delta;
+    record.type = LogRecord::CHANNELS;
+    record.mask = mask;
+    record.offset = _offset;
+    record.timestamp = _timestamp + _offset * _intervalSec;
+    return used;
+  }
+
+  // An entry of one byte, or two with the pulse difference after it.
+  // Returns 0 for anything else, leaving offset and pulses alone.
+  static inline size_t shortEntry(const uint8_t* data, size_t len, uint32_t& offset, uint16_t& pulses)
+  {
+    if (len < 2 || !data[0] || (data[0] & 0x80))
+      return 0;
+
+    uint32_t diff = data[0] & LOG_PULSES_INLINE;
+    size_t n = 1;
+    if (diff == LOG_PULSES_INLINE) {
+      if (data[1] & 0x80)
+        return 0;
+      diff = data[1];
+      n = 2;
+    }
+
+    offset += data[0] >> 3;
+    pulses += logcodec::unzigzag(diff);
+    return n;
+  }
+
+  // Truncated input waits for more data; a malformed varint skips a byte
+  inline size_t invalid(size_t available, size_t needed, LogRecord& record)
+  {
+    if (available < needed)
+      return 0;
+
+    record.type = LogRecord::INVALID;
+    return 1;
+  }
+
+  uint16_t _intervalSec;
+  uint32_t _timestamp;
+  uint32_t _offset;
+  uint16_t _pulses;
+  uint32_t _invalid;
+};
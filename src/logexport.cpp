@@ -0,0 +1,135 @@
+#include <string.h>
+
+#include "logexport.h"
+
+static size_t formatUInt(char* out, uint32_t value)
+{
+  char digits[10];
+  size_t len = 0, i = 0;
+
+  do {
+    digits[len++] = '0' + value % 10;
+    value /= 10;
+  } while (value);
+
+  while (len)
+    out[i++] = digits[--len];
+  return i;
+}
+
+LogExport::LogExport(const SegmentLog& log, LogPosition from, LogPosition to, Format format,
+                     uint32_t fromTime, uint32_t toTime)
+    : _reader(log, from, to)
+{
+  _format = format;
+  _stage = START;
+  _first = true;
+
+  _fromTime = fromTime;
+  _toTime = toTime;
+
+  _inputPos = 0;
+  _inputUsed = 0;
+  _linePos = 0;
+  _lineLen = 0;
+}
+
+size_t LogExport::read(uint8_t* buffer, size_t len)
+{
+  size_t size = 0;
+  LogRecord record;
+
+  while (size < len) {
+    if (_linePos < _lineLen) {
+      size_t n = _lineLen - _linePos;
+      if (n > len - size)
+        n = len - size;
+
+      memcpy(buffer + size, _line + _linePos, n);
+      _linePos += n;
+      size += n;
+      continue;
+    }
+
+    switch (_stage) {
+      case START:
+        formatText(_format == CSV ? "timestamp,pulses\n" : "[");
+        _stage = BODY;
+        break;
+
+      case BODY:
+        if (nextEntry(record))
+          formatEntry(record);
+        else
+          _stage = FINISH;
+        break;
+
+      case FINISH:
+        formatText(_format == CSV ? "" : "]\n");
+        _stage = DONE;
+        break;
+
+      case DONE:
+        return size;
+    }
+  }
+
+  return size;
+}
+
+// Next entry within the time range; false at the end of the log
+bool LogExport::nextEntry(LogRecord& record)
+{
+  for (;;) {
+    size_t n = _decoder.next(_input + _inputPos, _inputUsed - _inputPos, record);
+    if (n > 0) {
+      _inputPos += n;
+      if (record.type == LogRecord::ENTRY && record.timestamp >= _fromTime && record.timestamp <= _toTime)
+        return true;
+      continue;
+    }
+
+    // Keep the incomplete record and refill behind it
+    memmove(_input, _input + _inputPos, _inputUsed - _inputPos);
+    _inputUsed -= _inputPos;
+    _inputPos = 0;
+
+    size_t size = _reader.read(_input + _inputUsed, sizeof(_input) - _inputUsed);
+    if (size == 0)
+      return false;
+    _inputUsed += size;
+  }
+}
+
+void LogExport::formatEntry(const LogRecord& record)
+{
+  char* out = _line;
+
+  if (_format == CSV) {
+    out += formatUInt(out, record.timestamp);
+    *out++ = ',';
+    out += formatUInt(out, record.pulses);
+    *out++ = '\n';
+  } else {
+    if (!_first)
+      *out++ = ',';
+    memcpy(out, "{\"t\":", 5);
+    out += 5;
+    out += formatUInt(out, record.timestamp);
+    memcpy(out, ",\"p\":", 5);
+    out += 5;
+    out += formatUInt(out, record.pulses);
+    *out++ = '}';
+  }
+
+  _first = false;
+  _linePos = 0;
+  _lineLen = out - _line;
+}
+
+void LogExport::formatText(const char* text)
+{
+  _lineLen = strlen(text);
+  _linePos = 0;
+  memcpy(_line, text, _lineLen);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "logcodec.h"
+#include "segmentlog.h"
+
+#define EXPORT_INPUT_SIZE  128   // bytes of encoded log decoded at a time
+#define EXPORT_LINE_SIZE   40    // longest formatted entry
+
+// Decodes the sensor log into CSV or JSON text on the fly. Memory use is
+// fixed whatever the log size, so it can feed a chunked HTTP response.
+class LogExport
+{
+public:
+  enum Format { CSV, JSON };
+
+  LogExport(const SegmentLog& log, LogPosition from, LogPosition to, Format format,
+            uint32_t fromTime = 0, uint32_t toTime = UINT32_MAX);
+
+  size_t read(uint8_t* buffer, size_t len);
+
+private:
+  enum Stage { START, BODY, FINISH, DONE };
+
+  bool nextEntry(LogRecord& record);
+  void formatEntry(const LogRecord& record);
+  void formatText(const char* text);
+
+  SegmentReader _reader;
+  LogDecoder _decoder;
+  Format _format;
+  Stage _stage;
+  bool _first;
+
+  uint32_t _fromTime;
+  uint32_t _toTime;
+
+  uint8_t _input[EXPORT_INPUT_SIZE];
+  size_t _inputPos;
+  size_t _inputUsed;
+
+  char _line[EXPORT_LINE_SIZE];
+  size_t _linePos;
+  size_t _lineLen;
+};
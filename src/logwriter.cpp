@@ -0,0 +1,198 @@
+#include <eventlog.h>
+#include <metrics.h>
+
+#include "logcodec.h"
+#include "logwriter.h"
+
+static Histogram _sliceTime("elmer_log_write_seconds", "One sensor log slice written to flash");
+static Counter _bytesWritten("elmer_log_bytes_written_total", "Sensor log bytes written to flash");
+static Counter _bytesLost("elmer_log_bytes_lost_total", "Sensor log bytes dropped because flash refused them");
+
+LogWriter::LogWriter(size_t bufferSize, uint16_t maxAgeSec)
+{
+  // A buffer becomes one framed chunk, and recovery only finds frames that
+  // close at most STORAGE_MAX_CHUNK bytes
+  if (bufferSize > STORAGE_MAX_CHUNK)
+    bufferSize = STORAGE_MAX_CHUNK;
+
+  _log = nullptr;
+  _buffers[0] = nullptr;
+  _buffers[1] = nullptr;
+  _bufferSize = bufferSize;
+  _limit = bufferSize;
+  _maxAgeSec = maxAgeSec;
+
+  _active = 0;
+  _used = 0;
+  _activeSince = 0;
+  _pendingUsed = 0;
+  _pendingPos = 0;
+  _maxStall = 0;
+}
+
+LogWriter::~LogWriter()
+{
+  delete[] _buffers[0];
+  delete[] _buffers[1];
+}
+
+bool LogWriter::begin(SegmentLog* log)
+{
+  _log = log;
+
+  if (!_buffers[0]) {
+    _buffers[0] = new uint8_t[_bufferSize];
+    _buffers[1] = new uint8_t[_bufferSize];
+  }
+  return _buffers[0] && _buffers[1];
+}
+
+uint8_t* LogWriter::reserve(size_t len)
+{
+  if (_limit - _used < len)
+    swap();
+
+  return _buffers[_active] + _used;
+}
+
+void LogWriter::commit(size_t len)
+{
+  if (_used == 0 && len > 0)
+    _activeSince = millis();
+
+  _used += len;
+}
+
+bool LogWriter::restore(const uint8_t* data, size_t len)
+{
+  if (!_buffers[_active] || _used > 0 || len > _limit)
+    return false;
+
+  memcpy(_buffers[_active], data, len);
+  commit(len);
+  return true;
+}
+
+void LogWriter::update()
+{
+  uint32_t start = micros();
+
+  if (_pendingUsed > 0)
+    writeSlice();
+  else if (_used > 0 && millis() - _activeSince >= _maxAgeSec * 1000UL)
+    swap();   // bound the data a power failure can take; written from the next update
+  else
+    return;
+
+  measure(start);
+}
+
+void LogWriter::sync()
+{
+  uint32_t start = micros();
+
+  if (!_log)
+    return;
+
+  swap();
+  while (!writeSlice())
+    ;
+  _log->sync();
+
+  measure(start);
+}
+
+void LogWriter::discard()
+{
+  _used = 0;
+  _pendingUsed = 0;
+  _pendingPos = 0;
+}
+
+// Hand the active buffer over for writing. Only blocks if the previous one
+// is still in flight, i.e. the buffer filled faster than update() drained it.
+void LogWriter::swap()
+{
+  uint32_t start = micros();
+
+  if (_pendingUsed > 0) {
+    while (!writeSlice())
+      ;
+    measure(start);
+  }
+
+  _pendingUsed = _used;
+  _pendingPos = 0;
+  _active ^= 1;
+  _used = 0;
+}
+
+// Writes one page-aligned slice of the pending buffer, then commits it on
+// the following call. Returns true once nothing is left pending.
+bool LogWriter::writeSlice()
+{
+  if (_pendingUsed == 0)
+    return true;
+
+  // Committed at once: RTC memory only mirrors the active buffer, so a
+  // reset must not find this one written but not yet durable
+  if (_pendingPos == _pendingUsed) {
+    _log->sync();
+    _pendingUsed = 0;
+    _pendingPos = 0;
+    return true;
+  }
+
+  // Rotating here keeps every segment starting on a buffer boundary
+  if (_pendingPos == 0 && _log->full()) {
+    if (_log->rotate())
+      return false;
+
+    _events.log(EventLog::ERROR, PSTR("Failed to start a log segment"));
+    _bytesLost.add(_pendingUsed);
+    _pendingUsed = 0;
+    return true;
+  }
+
+  if (_pendingPos == 0)
+    indexBlock();
+
+  size_t len = LOG_PAGE_SIZE - _log->size() % LOG_PAGE_SIZE;
+  if (len > _pendingUsed - _pendingPos)
+    len = _pendingUsed - _pendingPos;
+
+  size_t written;
+  {
+    MetricTimer timer(_sliceTime);
+    written = _log->write(_buffers[_active ^ 1] + _pendingPos, len);
+  }
+  _bytesWritten.add(written);
+
+  if (written != len) {
+    _events.log(EventLog::ERROR, PSTR("Failed to write log buffer"));
+    _bytesLost.add(_pendingUsed - _pendingPos - written);
+    _pendingUsed = 0;
+    _pendingPos = 0;
+    return true;
+  }
+
+  _pendingPos += len;
+  return false;
+}
+
+void LogWriter::measure(uint32_t start)
+{
+  uint32_t elapsed = micros() - start;
+  if (elapsed > _maxStall)
+    _maxStall = elapsed;
+}
+
+// Blocks opening with a marker are indexed by its timestamp
+void LogWriter::indexBlock()
+{
+  LogDecoder decoder;
+  LogRecord record;
+
+  if (decoder.next(_buffers[_active ^ 1], _pendingUsed, record) && record.type == LogRecord::MARKER)
+    _log->index(record.timestamp);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "segmentlog.h"
+
+#define LOG_PAGE_SIZE  256   // flash program page; writes are sliced and aligned to it
+
+// Double-buffered log writer: one buffer fills while the other is written out
+// one flash page per update() call, so a flush never stalls loop() for long.
+// Segments rotate only between buffers, so each buffer should start with a
+// record that decodes on its own (see fresh()).
+class LogWriter
+{
+public:
+  // bufferSize is capped at STORAGE_MAX_CHUNK
+  LogWriter(size_t bufferSize, uint16_t maxAgeSec);
+  ~LogWriter();
+
+  bool begin(SegmentLog* log);
+
+  // Returns room for len bytes in the active buffer, swapping buffers if needed
+  uint8_t* reserve(size_t len);
+  inline bool fresh(size_t len) const { return _used == 0 || _limit - _used < len; }  // reserve(len) starts a buffer
+  void commit(size_t len);
+
+  // Use at most `bytes` of each buffer, e.g. to keep the active one mirrorable
+  inline void limit(size_t bytes) { _limit = bytes < _bufferSize ? bytes : _bufferSize; }
+
+  // Refill the empty active buffer with data saved before a restart
+  bool restore(const uint8_t* data, size_t len);
+
+  void update();    // Call regularly from loop()
+  void sync();      // Write and commit everything now
+  void discard();   // Drop all buffered data
+
+  inline size_t bufferSize() const { return _bufferSize; }
+  inline size_t buffered() const { return _used + _pendingUsed - _pendingPos; }
+  inline const uint8_t* active() const { return _buffers[_active]; }   // Not yet handed to flash
+  inline size_t activeUsed() const { return _used; }
+  inline uint32_t maxStallMicros() const { return _maxStall; }   // Worst single call so far
+  inline void resetMaxStall() { _maxStall = 0; }
+
+private:
+  void swap();
+  bool writeSlice();
+  void indexBlock();
+  inline void measure(uint32_t start);
+
+  SegmentLog* _log;
+  uint8_t* _buffers[2];
+  size_t _bufferSize;
+  size_t _limit;
+  uint16_t _maxAgeSec;
+
+  uint8_t _active;              // buffer being filled
+  size_t _used;
+  unsigned long _activeSince;   // millis() of the oldest byte in the active buffer
+
+  size_t _pendingUsed;          // bytes in the other buffer waiting for flash
+  size_t _pendingPos;           // ...of which already written
+
+  uint32_t _maxStall;
+};
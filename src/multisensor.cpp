@@ -0,0 +1,148 @@
+#include <eventlog.h>
+#include <scheduler.h>
+
+#include "multisensor.h"
+#include "sensor.h"
+
+#define BLOCK_START  (LOG_MAX_RECORD + LOG_MAX_CHANNEL_RECORD)   // marker plus the first record
+
+const char _multisensor_dir[] = "/channels";
+
+// Clamped before it narrows to the debouncer's uint8_t: 256 ms would wrap to 0
+static uint8_t debounceTicks(uint16_t millisInterval)
+{
+  uint32_t ticks = ((uint32_t)millisInterval + MULTI_SENSOR_POLL_MS - 1) / MULTI_SENSOR_POLL_MS;
+  return ticks < (1 << VERTICAL_BITS) ? ticks : (1 << VERTICAL_BITS) - 1;
+}
+
+MultiSensor::MultiSensor(const uint8_t* pins, uint8_t channels, uint16_t millisInterval, uint16_t intervalSec,
+                         uint32_t budget, size_t bufferSize, uint16_t maxAgeSec)
+    : _debouncer(debounceTicks(millisInterval)),
+      _writer(bufferSize, maxAgeSec), _segments(_multisensor_dir, SEGMENT_SIZE, budget)
+{
+  _channels = channels < LOG_MAX_CHANNELS ? channels : LOG_MAX_CHANNELS;
+  memcpy(_pins, pins, _channels);
+  _intervalSec = intervalSec;
+  memset(_counts, 0, sizeof(_counts));
+  _lastOffset = 0;
+  _startTime = 0;
+  _task = -1;
+}
+
+MultiSensor::~MultiSensor()
+{
+  _writer.sync();
+}
+
+bool MultiSensor::begin(int mode)
+{
+  for (uint8_t channel = 0; channel < _channels; channel++) {
+    if (_pins[channel] >= 16) {
+      _events.log(EventLog::ERROR, PSTR("MultiSensor: GPIO%u cannot be sampled"), _pins[channel]);
+      return false;
+    }
+    pinMode(_pins[channel], mode);
+  }
+
+  _debouncer.begin(sample());
+
+  if (_segments.begin(_intervalSec) && !_writer.begin(&_segments))
+    _events.log(EventLog::ERROR, PSTR("Failed to allocate log buffers"));
+
+  if (_task < 0)
+    _task = _scheduler.every("channels", MULTI_SENSOR_POLL_MS, onTask, this);
+  return true;
+}
+
+void MultiSensor::onTask(void* arg)
+{
+  static_cast<MultiSensor*>(arg)->update(time(nullptr));
+}
+
+// One register read for all channels, gathered into channel order
+inline uint16_t MultiSensor::sample() const
+{
+  uint32_t inputs = GPI;
+  uint16_t levels = 0;
+
+  for (uint8_t channel = 0; channel < _channels; channel++)
+    levels |= ((inputs >> _pins[channel]) & 1) << channel;
+  return levels;
+}
+
+// Called once per tick: the debouncer counts ticks, not milliseconds
+void MultiSensor::update()
+{
+  _debouncer.update(sample());
+
+  for (uint32_t bits = _debouncer.fell(); bits; bits &= bits - 1)
+    _counts[__builtin_ctz(bits)]++;
+}
+
+void MultiSensor::emptyLogFile()
+{
+  _writer.discard();
+  _segments.clear();
+}
+
+void MultiSensor::rebase(uint32_t base)
+{
+  _startTime += base * _intervalSec;
+  _lastOffset = _lastOffset > base ? _lastOffset - base : 0;
+
+  uint8_t* out = _writer.reserve(BLOCK_START);
+  _writer.commit(_encoder.marker(out, _startTime));
+}
+
+void MultiSensor::saveLogEntry(uint16_t offset)
+{
+  uint16_t mask = 0;
+  for (uint8_t channel = 0; channel < _channels; channel++) {
+    if (_counts[channel])
+      mask |= 1 << channel;
+  }
+
+  // Intervals without pulses on any channel encode to nothing
+  if (mask == 0) {
+    _lastOffset = offset;
+    return;
+  }
+
+  if (_writer.fresh(BLOCK_START)) {
+    offset -= _lastOffset;
+    rebase(_lastOffset);
+  }
+
+  _lastOffset = offset;
+
+  uint8_t* out = _writer.reserve(LOG_MAX_CHANNEL_RECORD);
+  _writer.commit(_encoder.channels(out, offset, mask, _counts));
+  memset(_counts, 0, sizeof(_counts));
+}
+
+void MultiSensor::update(time_t currentTime)
+{
+  update();
+  _writer.update();
+
+  if (currentTime >= SENSOR_MIN_TIME) {
+    if (_startTime == 0)
+      _startTime = currentTime - currentTime % _intervalSec;
+
+    logInterval((currentTime - _startTime) / _intervalSec);
+  }
+}
+
+void MultiSensor::logInterval(uint32_t offset)
+{
+  if (offset == _lastOffset)
+    return;
+
+  if (offset >= UINT16_MAX) {
+    rebase(offset - 1);
+    offset = 1;
+    _events.log(EventLog::INFO, PSTR("MultiSensor: reset timestamp at %lu"), _startTime);
+  }
+
+  saveLogEntry(offset);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <debouncer.h>
+#include <FS.h>
+
+#include "logcodec.h"
+#include "logwriter.h"
+#include "segmentlog.h"
+
+#define MULTI_SENSOR_POLL_MS  1   // sampling period of all channels
+
+// Several meters on GPIO0-15, sampled together with a single read of the GPIO
+// input register per tick. A VerticalDebouncer debounces all channels at once,
+// with the interval rounded up to whole ticks, and falling edges are counted
+// per channel; every interval with pulses becomes one channel record (mask
+// plus counts, see LOG_TAG_CHANNELS) in a shared segment log.
+class MultiSensor
+{
+private:
+  uint8_t _pins[LOG_MAX_CHANNELS];
+  uint8_t _channels;
+  uint16_t _intervalSec;
+
+  VerticalDebouncer _debouncer;   // a bit per channel
+
+  uint16_t _counts[LOG_MAX_CHANNELS];       // current interval
+  uint16_t _lastOffset;
+  uint32_t _startTime;
+
+  LogEncoder _encoder;
+  LogWriter _writer;
+  SegmentLog _segments;
+
+  int8_t _task;
+
+public:
+  // pins must be GPIO0-15: GPIO16 is not in the input register. millisInterval
+  // is capped at 63 ticks. budget is the flash /channels may keep; a Sensor
+  // in the same sketch keeps its own SEGMENT_BUDGET, so the two must fit
+  // the filesystem together.
+  MultiSensor(const uint8_t* pins, uint8_t channels, uint16_t millisInterval, uint16_t intervalSec,
+              uint32_t budget, size_t bufferSize = 2048, uint16_t maxAgeSec = 3600);
+  ~MultiSensor();
+
+  bool begin(int pinMode);
+  void update(time_t currentTime);
+  void update();
+
+  void emptyLogFile();
+
+  inline uint8_t channels() const { return _channels; }
+  inline uint16_t levels() const { return _debouncer.read(); }   // Debounced level by channel
+  inline uint16_t fell() const { return _debouncer.fell(); }     // Channels that fell in the last update()
+  inline uint16_t pulses(uint8_t channel) const { return _counts[channel]; }   // Current interval
+  inline const SegmentLog& segments() const { return _segments; }
+
+private:
+  static void onTask(void* arg);
+  inline uint16_t sample() const;
+
+  void rebase(uint32_t base);
+  void logInterval(uint32_t offset);
+  void saveLogEntry(uint16_t offset);
+};
+
+extern const char _multisensor_dir[];
@@ -0,0 +1,146 @@
+#include <eventlog.h>
+#include <LittleFS.h>
+
+#include "rollup.h"
+
+// Global implementation
+const char _rollup_hour_path[] = "/rollup/hour.bin";
+const char _rollup_day_path[] = "/rollup/day.bin";
+
+// Class implementation
+Rollup::Rollup(const char* path, uint32_t periodSec, uint32_t maxRecords)
+{
+  _path = path;
+  _periodSec = periodSec;
+  _maxRecords = maxRecords;
+  _current = {};
+}
+
+void Rollup::add(uint32_t timestamp, uint16_t pulses)
+{
+  uint32_t start = period(timestamp);
+
+  if (start != _current.start) {
+    if (_current.count > 0)
+      append();
+
+    _current = { start, 0, UINT16_MAX, 0, 0, 0 };
+  }
+
+  _current.sum += pulses;
+  if (pulses < _current.min)
+    _current.min = pulses;
+  if (pulses > _current.max)
+    _current.max = pulses;
+  _current.count++;
+}
+
+void Rollup::append()
+{
+  File file = LittleFS.open(_path, "a");
+  if (!file || file.write((const uint8_t*)&_current, sizeof(_current)) != sizeof(_current)) {
+    _events.log(EventLog::ERROR, PSTR("Failed to write %s"), _path);
+    return;
+  }
+
+  if (file.size() >= ROLLUP_FILE_MAX(_maxRecords))
+    trim(file);
+}
+
+// Copy the newest _maxRecords to a new file and rename it over the old one,
+// which LittleFS does atomically; an eighth of the records goes at a time
+void Rollup::trim(File& file)
+{
+  char path[32];
+  uint8_t buffer[16 * sizeof(RollupRecord)];
+  size_t n = 0;
+
+  file.close();
+  snprintf(path, sizeof(path), "%s.tmp", _path);
+
+  File in = LittleFS.open(_path, "r");
+  File out = LittleFS.open(path, "w");
+  bool ok = in && out && in.seek(in.size() - _maxRecords * sizeof(RollupRecord));
+
+  while (ok && (n = in.read(buffer, sizeof(buffer))) > 0)
+    ok = out.write(buffer, n) == n;
+
+  in.close();
+  out.close();
+  if (!ok || !LittleFS.rename(path, _path)) {
+    _events.log(EventLog::ERROR, PSTR("Failed to trim %s"), _path);
+    LittleFS.remove(path);
+  }
+}
+
+void Rollup::clear()
+{
+  LittleFS.remove(_path);
+  _current = {};
+}
+
+uint32_t Rollup::find(uint32_t timestamp) const
+{
+  File file = LittleFS.open(_path, "r");
+  if (!file)
+    return 0;
+
+  uint32_t low = 0, high = file.size() / sizeof(RollupRecord);
+  RollupRecord record;
+
+  timestamp = timestamp ? period(timestamp) : 0;
+  while (low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    if (!file.seek(mid * sizeof(RollupRecord)) || file.read((uint8_t*)&record, sizeof(record)) != sizeof(record))
+      break;
+
+    if (record.start < timestamp)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
+}
+
+// Reader
+RollupReader::RollupReader(const Rollup& rollup, uint32_t from, uint32_t to)
+{
+  _file = LittleFS.open(rollup.path(), "r");
+  if (_file)
+    _file.seek(rollup.find(from) * sizeof(RollupRecord));
+
+  _to = to;
+  _header = true;
+  _linePos = 0;
+  _lineLen = 0;
+}
+
+size_t RollupReader::read(uint8_t* buffer, size_t len)
+{
+  size_t size = 0;
+  RollupRecord record;
+
+  while (size < len) {
+    if (_linePos == _lineLen) {
+      if (_header) {
+        _header = false;
+        _lineLen = snprintf(_line, sizeof(_line), "start,sum,min,max,count\n");
+      } else if (_file && _file.read((uint8_t*)&record, sizeof(record)) == sizeof(record) && record.start <= _to)
+        _lineLen = snprintf(_line, sizeof(_line), "%u,%u,%u,%u,%u\n", record.start, record.sum, record.min, record.max, record.count);
+      else
+        break;
+
+      _linePos = 0;
+    }
+
+    size_t n = _lineLen - _linePos;
+    if (n > len - size)
+      n = len - size;
+
+    memcpy(buffer + size, _line + _linePos, n);
+    _linePos += n;
+    size += n;
+  }
+
+  return size;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <FS.h>
+
+struct RollupRecord {
+  uint32_t start;     // period start, epoch seconds (UTC); holds the intervals ending in (start, start + period]
+  uint32_t sum;       // pulses
+  uint16_t min;       // fewest pulses in one interval
+  uint16_t max;       // most pulses in one interval
+  uint16_t count;     // intervals seen; lower than expected while powered off
+  uint16_t reserved;
+};
+
+static_assert(sizeof(RollupRecord) == 16, "RollupRecord must stay 16 bytes");
+
+// Most bytes a rollup keeping `records` takes on flash: it may run an eighth
+// over before the oldest records are trimmed
+#define ROLLUP_FILE_MAX(records)  (((records) + (records) / 8) * sizeof(RollupRecord))
+
+// One downsampled tier of the sensor log, kept as a file of fixed-size records.
+// Intervals are folded in as they close; each period costs one append. Like
+// log entries, intervals are stamped with their end. Only the newest
+// `maxRecords` periods are kept, see ROLLUP_FILE_MAX.
+class Rollup
+{
+public:
+  Rollup(const char* path, uint32_t periodSec, uint32_t maxRecords);
+
+  void add(uint32_t timestamp, uint16_t pulses);   // timestamp: end of the interval
+  void clear();
+
+  uint32_t find(uint32_t timestamp) const;  // First record with intervals ending at timestamp or later
+
+  // The period still being folded, e.g. to carry it across a restart
+  inline const RollupRecord& current() const { return _current; }
+  inline void restore(const RollupRecord& current) { _current = current; }
+
+  inline const char* path() const { return _path; }
+  inline uint32_t periodSec() const { return _periodSec; }
+
+private:
+  void append();
+  void trim(File& file);
+  inline uint32_t period(uint32_t timestamp) const { return (timestamp - 1) - (timestamp - 1) % _periodSec; }
+
+  const char* _path;
+  uint32_t _periodSec;
+  uint32_t _maxRecords;
+  RollupRecord _current;
+};
+
+// Streams the records between two times as CSV
+class RollupReader
+{
+public:
+  RollupReader(const Rollup& rollup, uint32_t from, uint32_t to);
+
+  size_t read(uint8_t* buffer, size_t len);
+
+private:
+  File _file;
+  uint32_t _to;
+  bool _header;
+
+  char _line[64];
+  size_t _linePos;
+  size_t _lineLen;
+};
+
+extern const char _rollup_hour_path[];
+extern const char _rollup_day_path[];
@@ -0,0 +1,382 @@
+#include <eventlog.h>
+#include <LittleFS.h>
+
+#include "logcodec.h"
+#include "segmentlog.h"
+
+#define MANIFEST_MAGIC  0x31474553   // "SEG1"
+
+static const StorageFraming _segmentFraming = { LOG_FRAME_SIZE, LogEncoder::frame, logcodec::getFrame };
+
+struct Manifest {
+  uint32_t magic;
+  uint32_t first;
+  uint32_t last;
+  uint32_t check;     // ~(first ^ last)
+};
+
+// Class implementation
+SegmentLog::SegmentLog(const char* dir, uint32_t segmentSize, uint32_t budget)
+{
+  _dir = dir;
+  _segmentSize = segmentSize;
+  _budget = budget;
+  _intervalSec = 0;
+
+  _first = 0;
+  _last = 0;
+}
+
+bool SegmentLog::begin(uint16_t intervalSec, const char* legacyPath)
+{
+  _intervalSec = intervalSec;
+
+  LittleFS.mkdir(_dir);
+  if (!loadManifest()) {
+    scan();
+    if (legacyPath)
+      adopt(legacyPath);
+    saveManifest();
+  }
+
+  return open(_last);
+}
+
+void SegmentLog::path(char* out, uint32_t segment) const
+{
+  snprintf(out, SEGMENT_PATH_MAX, "%s/%06u.bin", _dir, segment);
+}
+
+// Open a segment for appending; a new one starts with the file header
+bool SegmentLog::open(uint32_t segment)
+{
+  char name[SEGMENT_PATH_MAX];
+
+  path(name, segment);
+  if (!_file.open(name, &_segmentFraming)) {
+    _events.log(EventLog::ERROR, PSTR("Failed to open log file"));
+    return false;
+  }
+
+  if (_file.recovered())
+    _events.log(EventLog::WARN, PSTR("Log: cut %lu torn bytes off %s"), (unsigned long)_file.recovered(), name);
+
+  if (_file.size() == 0) {
+    uint8_t header[sizeof(LogHeader)];
+    _file.write(header, LogEncoder::header(header, _intervalSec));
+    _file.commit();
+  }
+  return true;
+}
+
+size_t SegmentLog::write(const uint8_t* data, size_t len)
+{
+  if (!_file)
+    return 0;
+
+  return _file.write(data, len);
+}
+
+void SegmentLog::sync()
+{
+  _file.commit();
+  _index.commit();
+}
+
+bool SegmentLog::rotate()
+{
+  _file.close();
+  _last++;
+
+  dropOldest();
+  saveManifest();
+  return open(_last);
+}
+
+static uint32_t fileSize(const char* path)
+{
+  File file = LittleFS.open(path, "r");
+  return file ? file.size() : 0;
+}
+
+// Budgets the real file sizes: a segment only rotates between buffers, so it
+// runs up to a framed chunk past _segmentSize, and the index counts too. The
+// segment about to start is reserved at its largest.
+void SegmentLog::dropOldest()
+{
+  char name[SEGMENT_PATH_MAX];
+  uint32_t first = _first;
+  uint32_t used = _segmentSize + STORAGE_MAX_CHUNK + LOG_FRAME_SIZE;
+
+  indexPath(name);
+  used += fileSize(name);
+  for (uint32_t segment = _first; segment < _last; segment++) {
+    path(name, segment);
+    used += fileSize(name);
+  }
+
+  while (used > _budget && _first < _last) {
+    path(name, _first++);
+    used -= fileSize(name);
+    LittleFS.remove(name);
+  }
+
+  if (_first != first)
+    compactIndex();
+}
+
+void SegmentLog::clear()
+{
+  char name[SEGMENT_PATH_MAX];
+
+  _file.close();
+  _index.close();
+  for (uint32_t segment = _first; segment <= _last; segment++) {
+    path(name, segment);
+    LittleFS.remove(name);
+  }
+
+  indexPath(name);
+  LittleFS.remove(name);
+
+  // Keep numbering monotonic so readers never mistake new data for old
+  _first = ++_last;
+  saveManifest();
+  open(_last);
+}
+
+bool SegmentLog::loadManifest()
+{
+  char name[SEGMENT_PATH_MAX];
+  Manifest manifest;
+
+  snprintf(name, sizeof(name), "%s/manifest", _dir);
+  File file = LittleFS.open(name, "r");
+  if (!file)
+    return false;
+
+  size_t size = file.read((uint8_t*)&manifest, sizeof(manifest));
+  if (size != sizeof(manifest) || manifest.magic != MANIFEST_MAGIC || manifest.check != ~(manifest.first ^ manifest.last) ||
+      manifest.first > manifest.last)
+    return false;
+
+  _first = manifest.first;
+  _last = manifest.last;
+  return true;
+}
+
+void SegmentLog::saveManifest()
+{
+  char name[SEGMENT_PATH_MAX];
+  Manifest manifest { MANIFEST_MAGIC, _first, _last, ~(_first ^ _last) };
+
+  snprintf(name, sizeof(name), "%s/manifest", _dir);
+  File file = LittleFS.open(name, "w");
+  if (!file || file.write((const uint8_t*)&manifest, sizeof(manifest)) != sizeof(manifest))
+    _events.log(EventLog::ERROR, PSTR("Failed to write log manifest"));
+}
+
+// Rebuild the segment range from the directory when the manifest is missing
+void SegmentLog::scan()
+{
+  Dir dir = LittleFS.openDir(_dir);
+  bool found = false;
+
+  _first = 0;
+  _last = 0;
+
+  while (dir.next()) {
+    uint32_t segment;
+    char extra;
+
+    if (sscanf(dir.fileName(), "%u.bi%c", &segment, &extra) != 2 || extra != 'n')
+      continue;
+
+    if (!found || segment < _first)
+      _first = segment;
+    if (!found || segment > _last)
+      _last = segment;
+    found = true;
+  }
+}
+
+// Take over an old single-file log as the newest segment if that slot is free
+void SegmentLog::adopt(const char* legacyPath)
+{
+  char name[SEGMENT_PATH_MAX];
+
+  path(name, _last);
+  if (LittleFS.exists(legacyPath) && !LittleFS.exists(name))
+    LittleFS.rename(legacyPath, name);
+}
+
+// Index
+void SegmentLog::indexPath(char* out) const
+{
+  snprintf(out, SEGMENT_PATH_MAX, "%s/index", _dir);
+}
+
+void SegmentLog::index(uint32_t timestamp)
+{
+  char name[SEGMENT_PATH_MAX];
+  IndexEntry entry { timestamp, _last, (uint32_t)_file.size() };
+
+  // Kept open: entries are committed along with the block they point to
+  indexPath(name);
+  if ((!_index && !_index.open(name)) || _index.write((const uint8_t*)&entry, sizeof(entry)) != sizeof(entry))
+    _events.log(EventLog::ERROR, PSTR("Failed to write log index"));
+}
+
+bool SegmentLog::readIndex(File& file, uint32_t at, IndexEntry& entry) const
+{
+  return file.seek(at * sizeof(IndexEntry)) && file.read((uint8_t*)&entry, sizeof(entry)) == sizeof(entry);
+}
+
+// Number of entries with a timestamp at or before `timestamp`
+uint32_t SegmentLog::search(File& file, uint32_t count, uint32_t timestamp) const
+{
+  uint32_t low = 0, high = count;
+  IndexEntry entry;
+
+  while (low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    if (!readIndex(file, mid, entry))
+      break;
+
+    if (entry.timestamp <= timestamp)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
+}
+
+LogPosition SegmentLog::find(uint32_t timestamp) const
+{
+  char name[SEGMENT_PATH_MAX];
+  IndexEntry entry;
+
+  indexPath(name);
+  File file = LittleFS.open(name, "r");
+  if (!file)
+    return { _first, 0 };
+
+  uint32_t at = search(file, file.size() / sizeof(IndexEntry), timestamp);
+  if (at == 0 || !readIndex(file, at - 1, entry) || entry.segment < _first)
+    return { _first, 0 };
+
+  return { entry.segment, entry.offset };
+}
+
+LogPosition SegmentLog::findAfter(uint32_t timestamp) const
+{
+  char name[SEGMENT_PATH_MAX];
+  IndexEntry entry;
+
+  indexPath(name);
+  File file = LittleFS.open(name, "r");
+  if (!file)
+    return end();
+
+  uint32_t count = file.size() / sizeof(IndexEntry);
+  uint32_t at = search(file, count, timestamp);
+  if (at == count || !readIndex(file, at, entry))
+    return end();
+
+  return { entry.segment, entry.offset };
+}
+
+// Drop entries of removed segments; they are a prefix of the file
+void SegmentLog::compactIndex()
+{
+  char name[SEGMENT_PATH_MAX], temp[SEGMENT_PATH_MAX];
+  uint8_t buffer[16 * sizeof(IndexEntry)];
+  IndexEntry entry;
+  size_t size;
+
+  _index.close();
+  indexPath(name);
+  File file = LittleFS.open(name, "r");
+  if (!file)
+    return;
+
+  uint32_t count = file.size() / sizeof(IndexEntry);
+  uint32_t low = 0, high = count;
+  while (low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    if (readIndex(file, mid, entry) && entry.segment < _first)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+
+  snprintf(temp, sizeof(temp), "%s/index.tmp", _dir);
+  File out = LittleFS.open(temp, "w");
+  file.seek(low * sizeof(IndexEntry));
+  while ((size = file.read(buffer, sizeof(buffer))) > 0)
+    out.write(buffer, size);
+
+  out.close();
+  file.close();
+  LittleFS.remove(name);
+  LittleFS.rename(temp, name);
+}
+
+// Reader
+SegmentReader::SegmentReader(const SegmentLog& log, LogPosition from, LogPosition to, bool header)
+    : _log(log), _pos(from), _end(to)
+{
+  if (_pos.segment < _log.first()) {
+    _pos.segment = _log.first();
+    _pos.offset = 0;
+  }
+
+  _header = header && _pos.offset > 0;
+}
+
+// Opens the segment at _pos, skipping segments dropped in the meantime
+bool SegmentReader::open()
+{
+  char name[SEGMENT_PATH_MAX];
+
+  while (_pos.segment < _end.segment || (_pos.segment == _end.segment && _pos.offset < _end.offset)) {
+    _log.path(name, _pos.segment);
+    _file = LittleFS.open(name, "r");
+    if (_file && _file.seek(_pos.offset))
+      return true;
+
+    _pos.segment++;
+    _pos.offset = 0;
+  }
+  return false;
+}
+
+size_t SegmentReader::read(uint8_t* buffer, size_t len)
+{
+  if (_header && len >= sizeof(LogHeader)) {
+    _header = false;
+    return LogEncoder::header(buffer, _log.intervalSec());
+  }
+
+  for (;;) {
+    if (!_file && !open())
+      return 0;
+
+    // The open segment keeps growing; stop at the snapshot taken up front
+    if (_pos.segment == _end.segment && len > _end.offset - _pos.offset)
+      len = _end.offset - _pos.offset;
+
+    size_t size = len ? _file.read(buffer, len) : 0;
+    if (size > 0) {
+      _pos.offset += size;
+      return size;
+    }
+
+    _file.close();
+    if (_pos.segment == _end.segment)
+      return 0;
+
+    _pos.segment++;
+    _pos.offset = 0;
+  }
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <FS.h>
+#include <storage.h>
+
+#define SEGMENT_PATH_MAX  32    // LittleFS path limit
+
+struct LogPosition {
+  uint32_t segment;
+  uint32_t offset;
+};
+
+// Sparse time index: where each written block (starting with a marker) begins
+struct IndexEntry {
+  uint32_t timestamp;
+  uint32_t segment;
+  uint32_t offset;
+};
+
+// Log stored as numbered fixed-size segment files (<dir>/000123.bin), each
+// starting with a LogHeader. The oldest segments are dropped to keep the total
+// within a byte budget; a small manifest saves listing the directory at boot.
+// Segments and the index are written through the storage layer, segments
+// framed with LOG_TAG_FRAME records.
+class SegmentLog
+{
+public:
+  SegmentLog(const char* dir, uint32_t segmentSize, uint32_t budget);
+
+  bool begin(uint16_t intervalSec, const char* legacyPath = nullptr);
+  void clear();
+
+  size_t write(const uint8_t* data, size_t len);
+  void sync();    // Durable now
+  bool rotate();
+
+  inline bool full() const { return _file.size() >= _segmentSize; }
+  inline uint32_t size() const { return _file.size(); }   // Bytes in the open segment
+  inline uint32_t first() const { return _first; }
+  inline uint32_t last() const { return _last; }
+  inline LogPosition end() const { return { _last, (uint32_t)_file.committed() }; }   // Durable end of the log
+  inline uint16_t intervalSec() const { return _intervalSec; }
+
+  void index(uint32_t timestamp);   // A block starting at `timestamp` is written next
+
+  // Binary searches the index: the block containing `timestamp`, or the first after it
+  LogPosition find(uint32_t timestamp) const;
+  LogPosition findAfter(uint32_t timestamp) const;
+
+  void path(char* out, uint32_t segment) const;
+
+private:
+  bool open(uint32_t segment);
+  void dropOldest();
+  void adopt(const char* legacyPath);
+
+  void indexPath(char* out) const;
+  uint32_t search(File& file, uint32_t count, uint32_t timestamp) const;
+  bool readIndex(File& file, uint32_t at, IndexEntry& entry) const;
+  void compactIndex();
+
+  bool loadManifest();
+  void saveManifest();
+  void scan();
+
+  const char* _dir;
+  uint32_t _segmentSize;
+  uint32_t _budget;
+  uint16_t _intervalSec;
+
+  uint32_t _first;
+  uint32_t _last;
+  StorageFile _file;
+  StorageFile _index;
+};
+
+// Streams the bytes between two positions across segment files. A stream not
+// starting at a segment start gets a LogHeader first so it decodes on its own,
+// unless it continues one the client already has (header = false).
+class SegmentReader
+{
+public:
+  SegmentReader(const SegmentLog& log, LogPosition from, LogPosition to, bool header = true);
+
+  size_t read(uint8_t* buffer, size_t len);
+
+private:
+  bool open();
+
+  const SegmentLog& _log;
+  LogPosition _pos;
+  LogPosition _end;
+  File _file;
+  bool _header;
+};
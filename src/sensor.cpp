@@ -1,102 +1,403 @@
 #include <eventlog.h>
 #include <LittleFS.h>
+#include <metrics.h>
 
 #include "sensor.h"
 
+#define BLOCK_START  (2 * LOG_MAX_RECORD)   // marker plus the first entry
+#define SNAPSHOT_MAGIC 0x31435452              // "RTC1"
+
 // Global implementation
+const char _sensorlog_dir[] = "/sensor";
 const char _sensorlog_path[] = "/sensor.bin";
+const char _sensorlog_v1_path[] = "/sensor.v1.bin";
+const char _sensor_capture_path[] = "/capture.bin";
+
+static Counter _pulses("elmer_sensor_pulses_total", "Debounced meter pulses");
+static Counter _edgesLost("elmer_sensor_edges_lost_total", "Pin edges dropped because the edge ring was full");
+static Histogram _updateTime("elmer_sensor_update_seconds", "Sensor::update(), log writing included");
 
 // Constructor takes sensor pin and pointer to Event
-Sensor::Sensor(uint8_t pin, uint16_t millisInterval, uint16_t intervalSec)
-    : Debouncer(pin, millisInterval)
+Sensor::Sensor(uint8_t pin, uint16_t intervalSec, Capture capture, size_t bufferSize, uint16_t maxAgeSec)
+    : _debouncer(pin), _writer(bufferSize, maxAgeSec),
+      _segments(_sensorlog_dir, SEGMENT_SIZE, SEGMENT_BUDGET - ROLLUP_BUDGET),
+      _hourly(_rollup_hour_path, 3600, ROLLUP_HOURS), _daily(_rollup_day_path, 86400, ROLLUP_DAYS)
 {
   _intervalSec = intervalSec;
   _pulseCount = 0;
+  _closedTime = 0;
+  _closedCount = 0;
   _lastOffset = 0;
+  _startTime = 0;
+  _task = -1;
+  _warmRestart = false;
+  _snapshot = {};
+  _capture = capture;
+  _edgeOverflows = 0;
+
+  _impulsesPerKWh = SENSOR_IMPULSES_KWH;
+  _timed = false;
+  _pulseMicros = 0;
+  _pulseMillis = 0;
+  _pulseInterval = 0;
+
+  _capturing = false;
+  _captureUsed = 0;
 }
 
 Sensor::~Sensor()
 {
-  if (_maxEntries > 0)
-      writeLogEntryBuffer(_maxEntries);
-
-  if (_logFile)
-    _logFile.close();
+  _writer.sync();
+  flushCapture();
 }
 
 // Open log file in append mode
 void Sensor::begin(int pinMode)
 {
-  Debouncer::begin(pinMode);
+  _debouncer.begin(pinMode);
+
+  if (_capture == INTERRUPT)
+    attachInterruptArg(digitalPinToInterrupt(_debouncer.pin()), onEdge, this, CHANGE);
 
   createLogFile();
+
+  // A fixed period keeps the latency from edge to count bounded
+  if (_task < 0)
+    _task = _scheduler.every("sensor", _capture == INTERRUPT ? SENSOR_DRAIN_MS : SENSOR_POLL_MS, onTask, this);
+
+  if (_warmRestart) {
+    _writer.limit(SENSOR_RTC_DATA);
+    if (restoreSnapshot())
+      _events.log(EventLog::INFO, PSTR("Sensor: restored %u bytes from RTC memory"), _snapshot.length);
+    else
+      _snapshot = {};   // no magic: the next update writes everything
+  }
 }
 
-void Sensor::createLogFile()
+inline uint32_t Sensor::snapshotChecksum() const
 {
-  _logFile = LittleFS.open(_sensorlog_path, "a");
-  if (!_logFile)
-    _events.log(EventLog::ERROR, "Failed to open log file");
+  const uint8_t* fields = (const uint8_t*)&_snapshot + 8;
+  return logcodec::crc32(fields, sizeof(_snapshot) - 8);
 }
 
-void Sensor::emptyLogFile()
+// Continue the interval and the log buffer that were open before the reset.
+// Power-on leaves random RTC memory behind, which fails the checksums.
+bool Sensor::restoreSnapshot()
 {
-  LittleFS.remove(_sensorlog_path);
-  createLogFile();
+  uint32_t data[SENSOR_RTC_DATA / 4];
+
+  if (!ESP.rtcUserMemoryRead(SENSOR_RTC_BLOCK, (uint32_t*)&_snapshot, sizeof(_snapshot)) ||
+      _snapshot.magic != SNAPSHOT_MAGIC || _snapshot.checksum != snapshotChecksum() ||
+      _snapshot.intervalSec != _intervalSec || _snapshot.length > SENSOR_RTC_DATA)
+    return false;
+
+  size_t dataBlock = SENSOR_RTC_BLOCK + sizeof(_snapshot) / 4;
+  if (!ESP.rtcUserMemoryRead(dataBlock, data, (_snapshot.length + 3) & ~3) ||
+      logcodec::crc32((const uint8_t*)data, _snapshot.length) != _snapshot.dataCrc)
+    return false;
+
+  if (!_writer.restore((const uint8_t*)data, _snapshot.length))
+    return false;
+
+  _startTime = _snapshot.startTime;
+  _lastOffset = _snapshot.lastOffset;
+  _pulseCount += _snapshot.pulseCount;
+  _encoder.resume(_snapshot.encoderOffset, _snapshot.encoderPulses);
+  _hourly.restore(_snapshot.hourly);
+  _daily.restore(_snapshot.daily);
+  return true;
 }
 
-void Sensor::writeLogEntryBuffer(size_t count)
+// Called after every update; RTC memory is written only for what changed.
+// The active buffer is mirrored before it can reach flash, so a restored
+// buffer never duplicates data already in a segment.
+void Sensor::saveSnapshot()
 {
-    size_t written = _logFile.write((const uint8_t*)_entries, sizeof(LogEntry) * count);
-    if (written != sizeof(LogEntry) * count)
-      _events.log(EventLog::ERROR, "Failed to write log buffer");
+  uint16_t length = _writer.activeUsed();
+  bool dataChanged = length != _snapshot.length || _startTime != _snapshot.startTime || _snapshot.magic != SNAPSHOT_MAGIC;
+
+  if (!dataChanged && _pulseCount == _snapshot.pulseCount && _lastOffset == _snapshot.lastOffset)
+    return;
+
+  if (dataChanged) {
+    size_t dataBlock = SENSOR_RTC_BLOCK + sizeof(_snapshot) / 4;
+    uint32_t data[SENSOR_RTC_DATA / 4];
 
-    _logFile.flush();
-    _maxEntries = 0;
+    memcpy(data, _writer.active(), length);
+    ESP.rtcUserMemoryWrite(dataBlock, data, (length + 3) & ~3);
+    _snapshot.length = length;
+    _snapshot.dataCrc = logcodec::crc32(_writer.active(), length);
+  }
+
+  _snapshot.magic = SNAPSHOT_MAGIC;
+  _snapshot.startTime = _startTime;
+  _snapshot.lastOffset = _lastOffset;
+  _snapshot.pulseCount = _pulseCount;
+  _snapshot.encoderOffset = _encoder.offset();
+  _snapshot.encoderPulses = _encoder.pulses();
+  _snapshot.intervalSec = _intervalSec;
+  _snapshot.hourly = _hourly.current();
+  _snapshot.daily = _daily.current();
+  _snapshot.checksum = snapshotChecksum();
+  ESP.rtcUserMemoryWrite(SENSOR_RTC_BLOCK, (uint32_t*)&_snapshot, sizeof(_snapshot));
 }
 
-void Sensor::resetTimestamp(time_t currentTime)
+void Sensor::onTask(void* arg)
 {
-    SegmentMarker marker { UINT16_MAX, currentTime };
+  static_cast<Sensor*>(arg)->update(time(nullptr));
+}
 
-    _startTime = currentTime;
-    _lastOffset = 0;
+// Runs in interrupt context: only timestamp the edge, debouncing happens in loop()
+IRAM_ATTR void Sensor::onEdge(void* arg)
+{
+  Sensor* sensor = static_cast<Sensor*>(arg);
+  sensor->_edges.push(micros(), digitalRead(sensor->_debouncer.pin()));
+}
 
-    if (_maxEntries > 0) {
-        writeLogEntryBuffer(_maxEntries);
-        _maxEntries = 0;
-    }
+void Sensor::createLogFile()
+{
+  migrateLogFile();
+
+  // A v2 single-file log becomes the first segment
+  if (!_segments.begin(_intervalSec, _sensorlog_path))
+    return;
+
+  if (!_writer.begin(&_segments))
+    _events.log(EventLog::ERROR, PSTR("Failed to allocate log buffers"));
+}
+
+// Keep a log written in the old fixed-size layout aside instead of appending to it
+void Sensor::migrateLogFile()
+{
+  File file = LittleFS.open(_sensorlog_path, "r");
+  if (!file)
+    return;
+
+  uint8_t header[sizeof(LogHeader)];
+  size_t size = file.read(header, sizeof(header));
+  file.close();
+
+  if (size == 0 || logcodec::isHeader(header, size))
+    return;
+
+  LittleFS.remove(_sensorlog_v1_path);
+  LittleFS.rename(_sensorlog_path, _sensorlog_v1_path);
+  _events.log(EventLog::WARN, PSTR("Sensor: moved v1 log to %s"), _sensorlog_v1_path);
+}
+
+void Sensor::emptyLogFile()
+{
+  // The next entry starts a new buffer and so a new marker
+  _writer.discard();
+  _segments.clear();
+
+  _hourly.clear();
+  _daily.clear();
+
+  _captureUsed = 0;
+  stopCapture();
+  LittleFS.remove(_sensor_capture_path);
+}
 
-    // Write delimiter and startTime as binary at start of file (4 or 8 bytes)
-    _logFile.write((const uint8_t*)&marker, sizeof(SegmentMarker));
-    _logFile.flush();
+// Move the segment start forward by `base` intervals and mark it. Keeping the
+// interval grid means pulses stay in the interval they were counted in.
+void Sensor::rebase(uint32_t base)
+{
+    _startTime += base * _intervalSec;
+    _lastOffset = _lastOffset > base ? _lastOffset - base : 0;
 
-    _events.log(EventLog::INFO, "Sensor: reset timestamp at %lu", currentTime);
+    uint8_t* out = _writer.reserve(BLOCK_START);
+    _writer.commit(_encoder.marker(out, _startTime));
 }
 
 void Sensor::saveLogEntry(uint16_t offset)
 {
     uint16_t count;
 
-    _entries[_maxEntries].offset = offset;
-    _lastOffset = offset;
-
     noInterrupts();
-    _entries[_maxEntries].pulses = _pulseCount;
+    count = _pulseCount;
     _pulseCount = 0;
     interrupts();
 
-    // Log info
-    if (++_maxEntries == BUFFER_SIZE)
-        writeLogEntryBuffer(BUFFER_SIZE);
+    // Fold the interval that just closed into the rollups, empty ones included.
+    // Like its log entry, it is stamped with its end.
+    uint32_t closed = _startTime + offset * _intervalSec;
+    _hourly.add(closed, count);
+    _daily.add(closed, count);
+    _closedTime = closed;
+    _closedCount = count;
+
+    // Empty intervals encode to nothing
+    if (count == 0) {
+      _lastOffset = offset;
+      return;
+    }
+
+    // Every buffer opens with a marker, so segments and blocks decode on their own
+    if (_writer.fresh(BLOCK_START)) {
+      offset -= _lastOffset;
+      rebase(_lastOffset);
+    }
+
+    _lastOffset = offset;
+
+    uint8_t* out = _writer.reserve(LOG_MAX_RECORD);
+    _writer.commit(_encoder.entry(out, offset, count));
+}
+
+// A fall is confirmed an interval after it happened: the pulse started at
+// the last raw change before the confirming sample
+inline void Sensor::sample(bool level, uint32_t nowMicros)
+{
+  uint32_t edgeMicros = _debouncer.since();
+
+  _debouncer.update(level, nowMicros);
+  if (_debouncer.fell()) {
+    _pulseCount++;
+    _pulses.add();
+    timePulse(edgeMicros);
+  }
+}
+
+void Sensor::timePulse(uint32_t atMicros)
+{
+  uint32_t now = millis();
+
+  _pulseInterval = _timed && now - _pulseMillis < SENSOR_MAX_GAP_MS ? atMicros - _pulseMicros : 0;
+  _pulseMicros = atMicros;
+  _pulseMillis = now;
+  _timed = true;
+
+  if (!_capturing)
+    return;
+
+  if (_captureUsed > SENSOR_CAPTURE_BUFFER - 5) {
+    flushCapture();
+    if (!_capturing)
+      return;
+  }
+
+  _captureUsed += logcodec::putVarint(_captureBuffer + _captureUsed, atMicros - _captureMicros);
+  _captureMicros = atMicros;
+}
+
+// Each pulse is worth 3.6e6 / impulsesPerKWh joules, spread over the last
+// interval. Until the next pulse the interval is at least the time since the
+// last one, so the estimate falls towards 0 when the load goes away instead
+// of holding its last value.
+float Sensor::power() const
+{
+  if (_pulseInterval == 0)
+    return 0;
+
+  uint32_t waitingMs = millis() - _pulseMillis;
+  if (waitingMs >= SENSOR_MAX_GAP_MS)
+    return 0;
+
+  uint32_t interval = _pulseInterval;
+  if (waitingMs > interval / 1000)
+    interval = waitingMs * 1000;
+
+  return 3.6e12f / ((float)_impulsesPerKWh * interval);
+}
+
+bool Sensor::startCapture(uint16_t seconds)
+{
+  stopCapture();
+
+  File file = LittleFS.open(_sensor_capture_path, "w");
+  if (!file) {
+    _events.log(EventLog::ERROR, PSTR("Sensor: cannot create %s"), _sensor_capture_path);
+    return false;
+  }
+
+  if (seconds > SENSOR_CAPTURE_SEC)
+    seconds = SENSOR_CAPTURE_SEC;
+
+  time_t now = time(nullptr);
+  CaptureHeader header = {};
+  memcpy(header.magic, "ECAP", 4);
+  header.startTime = now >= SENSOR_MIN_TIME ? now : 0;
+  header.impulsesPerKWh = _impulsesPerKWh;
+  header.seconds = seconds;
+  header.capture = _capture;
+  file.write((const uint8_t*)&header, sizeof(header));
+  file.close();
+
+  _capturing = true;
+  _captureMillis = millis();
+  _captureLength = seconds * 1000UL;
+  _captureMicros = micros();
+  _captureSize = sizeof(header);
+  _captureUsed = 0;
+
+  _events.log(EventLog::INFO, PSTR("Sensor: capturing pulse times for %u s"), seconds);
+  return true;
+}
+
+void Sensor::stopCapture()
+{
+  if (!_capturing)
+    return;
+
+  flushCapture();
+  _capturing = false;
+  _events.log(EventLog::INFO, PSTR("Sensor: capture ended, %lu bytes"), (unsigned long)_captureSize);
+}
+
+// Appends the collected deltas; a full file ends the capture
+void Sensor::flushCapture()
+{
+  if (_captureUsed == 0)
+    return;
+
+  if (_captureSize + _captureUsed > SENSOR_CAPTURE_SIZE) {
+    _captureUsed = 0;
+    stopCapture();
+    return;
+  }
+
+  File file = LittleFS.open(_sensor_capture_path, "a");
+  if (file) {
+    _captureSize += file.write(_captureBuffer, _captureUsed);
+    file.close();
+  }
+  _captureUsed = 0;
 }
 
 void Sensor::update()
 {
+  if (_capture == INTERRUPT) {
+    drainEdges();
+    return;
+  }
+
   // Detect rising edge (or falling edge depending on sensor)
-  Debouncer::update();
-  if (fell())
-    _pulseCount++;
+  sample(digitalRead(_debouncer.pin()), micros());
+}
+
+// Replay queued edges through the debouncer at their own times. Before each
+// edge the previous level gets a sample too, since it may have held long
+// enough to count; the next edge (or now) proves it.
+void Sensor::drainEdges()
+{
+  uint16_t overflows = _edges.overflows();
+  Edge edge;
+
+  while (_edges.pop(edge)) {
+    sample(_debouncer.unstable(), edge.micros);
+    sample(edge.level, edge.micros);
+  }
+
+  // After a gap the last queued level may be stale: take the pin's own
+  if (overflows != _edgeOverflows) {
+    _edgesLost.add((uint16_t)(overflows - _edgeOverflows));
+    _edgeOverflows = overflows;
+    sample(digitalRead(_debouncer.pin()), micros());
+    return;
+  }
+
+  sample(_debouncer.unstable(), micros());
 }
 
 uint32_t Sensor::calcOffset(time_t currentTime)
@@ -107,17 +408,47 @@ uint32_t Sensor::calcOffset(time_t currentTime)
 
 void Sensor::update(time_t currentTime)
 {
-    uint32_t offset = calcOffset(currentTime);
+    MetricTimer timer(_updateTime);
 
     // Update debouncer
     update();
 
+    // Write out at most one flash page per loop
+    _writer.update();
+
+    if (_capturing && millis() - _captureMillis >= _captureLength)
+      stopCapture();
+
+    // Pulses wait in the current interval until the clock is set
+    if (currentTime >= SENSOR_MIN_TIME) {
+      if (_startTime == 0)
+        _startTime = currentTime - currentTime % _intervalSec;
+
+      logInterval(calcOffset(currentTime));
+    }
+
+    if (_warmRestart)
+      saveSnapshot();
+}
+
+void Sensor::logInterval(uint32_t offset)
+{
     if (offset == _lastOffset)
       return;
 
+    // Intervals the task slept through closed empty: the log skips them, the
+    // rollups count them. A clock jump of more than a day is not filled in.
+    if (offset > _lastOffset + 1U && offset - _lastOffset <= 86400U / _intervalSec) {
+      for (uint32_t skipped = _lastOffset + 1; skipped < offset; skipped++) {
+        _hourly.add(_startTime + skipped * _intervalSec, 0);
+        _daily.add(_startTime + skipped * _intervalSec, 0);
+      }
+    }
+
     if (offset >= UINT16_MAX) {
-      resetTimestamp(currentTime);
-      // offset is now 0
+      rebase(offset - 1);
+      offset = 1;
+      _events.log(EventLog::INFO, PSTR("Sensor: reset timestamp at %lu"), _startTime);
     }
 
     saveLogEntry(offset);
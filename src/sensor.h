@@ -3,51 +3,164 @@
 #include <debouncer.h>
 #include <FS.h>
 
-#define BUFFER_SIZE  1024
+#include "edgering.h"
+#include "logcodec.h"
+#include "logwriter.h"
+#include "rollup.h"
+#include "segmentlog.h"
 
-struct SegmentMarker {
-  uint16_t delimiter;
-  time_t timestamp;
-};
+// Edges queued between drains; a power of two, at most 128 with 8-bit ring
+// indices. A bouncing contact gives ~10 edges a pulse, and a flash erase or a
+// web response can hold loop() off for ~100 ms: 128 edges ride that out up
+// to ~100 pulses a second.
+#define EDGE_RING_SIZE  128
+#define SENSOR_DEBOUNCE_MS 15         // a level must hold this long to count
+#define SENSOR_POLL_MS  1             // update period when polling the pin
+#define SENSOR_DRAIN_MS 10            // ...when draining the edge ring; well before it fills
+#define SEGMENT_SIZE    (16 * 1024)   // bytes per segment file, about a week of data
+#define SEGMENT_BUDGET  (1024 * 1024) // total bytes kept, rollups included; the oldest segments go first
+#define ROLLUP_HOURS    (366 * 24)    // hourly records kept, a year
+#define ROLLUP_DAYS     (10 * 366)    // daily records kept, ten years
+#define ROLLUP_BUDGET   (ROLLUP_FILE_MAX(ROLLUP_HOURS) + ROLLUP_FILE_MAX(ROLLUP_DAYS))
+
+#define SENSOR_MIN_TIME  1577836800    // 2020-01-01; earlier means the clock is not set yet
+#define SENSOR_RTC_BLOCK 32            // first RTC user memory block; those below belong to OTA
+#define SENSOR_RTC_DATA  320           // unflushed log bytes mirrored to RTC memory
+
+#define SENSOR_IMPULSES_KWH   1000     // meter constant, see setImpulsesPerKWh()
+#define SENSOR_MAX_GAP_MS     3600000  // longer pauses have no interval: micros() wraps after 71 minutes
+#define SENSOR_CAPTURE_SEC    3600     // longest capture, which keeps every delta within one micros() period
+#define SENSOR_CAPTURE_SIZE   (32 * 1024)  // capture file limit
+#define SENSOR_CAPTURE_BUFFER 128      // deltas collected in RAM before they are appended
 
-struct LogEntry {
-  uint16_t offset;
-  uint16_t pulses;
+// State mirrored to RTC user memory, which survives every reset but a power loss.
+// The active log buffer follows it, checked by dataCrc.
+struct SensorSnapshot {
+  uint32_t magic;
+  uint32_t checksum;        // CRC-32 of the fields below
+  uint32_t startTime;
+  uint16_t lastOffset;
+  uint16_t pulseCount;      // current interval
+  uint32_t encoderOffset;
+  uint16_t encoderPulses;
+  uint16_t intervalSec;
+  uint16_t length;          // bytes of log data
+  uint16_t reserved;
+  uint32_t dataCrc;
+  RollupRecord hourly;
+  RollupRecord daily;
 };
 
-class Sensor : Debouncer
+static_assert(sizeof(SensorSnapshot) % 4 == 0, "RTC memory is written in 32-bit blocks");
+static_assert(SENSOR_RTC_BLOCK * 4 + sizeof(SensorSnapshot) + SENSOR_RTC_DATA <= 512, "RTC user memory is 512 bytes");
+
+class Sensor
 {
+public:
+  enum Capture { POLLING, INTERRUPT };
+
 private:
+  StaticDebouncer<StablePolicy, SENSOR_DEBOUNCE_MS> _debouncer;
   uint16_t _intervalSec;
   uint16_t _lastOffset;
   uint32_t _startTime;
   volatile uint16_t _pulseCount;
+  uint32_t _closedTime;       // end of the last interval that closed
+  uint16_t _closedCount;
+
+  Capture _capture;
+  EdgeRing<EDGE_RING_SIZE> _edges;
+  uint16_t _edgeOverflows;    // _edges.overflows() when last drained
+
+  LogEncoder _encoder;
+  LogWriter _writer;
+  SegmentLog _segments;
+
+  Rollup _hourly;
+  Rollup _daily;
 
-  File _logFile;
+  int8_t _task;
 
-  LogEntry _entries[BUFFER_SIZE];
-  size_t _maxEntries;
+  bool _warmRestart;
+  SensorSnapshot _snapshot;   // as last written to RTC memory
+
+  uint16_t _impulsesPerKWh;
+  bool _timed;                // _pulseMicros holds a pulse
+  uint32_t _pulseMicros;      // when the last pulse started, after debouncing
+  uint32_t _pulseMillis;      // ...and millis() when it was counted, which does not wrap for 49 days
+  uint32_t _pulseInterval;    // us between the last two pulses, 0 if unknown
+
+  bool _capturing;
+  uint32_t _captureMillis;    // start of the capture
+  uint32_t _captureLength;    // ms
+  uint32_t _captureMicros;    // time the next delta is relative to
+  uint32_t _captureSize;      // bytes written so far
+  uint8_t _captureUsed;
+  uint8_t _captureBuffer[SENSOR_CAPTURE_BUFFER];
 
 public:
-  Sensor(uint8_t pin, uint16_t millisInterval, uint16_t intervalSec);
+  // bufferSize bytes (at most STORAGE_MAX_CHUNK) are allocated twice; maxAgeSec bounds how long an entry stays in RAM.
+  // That is also what a power cut can lose: RTC memory only outlives resets, so a longer age saves commits at that cost.
+  Sensor(uint8_t pin, uint16_t intervalSec, Capture capture = POLLING,
+         size_t bufferSize = 2048, uint16_t maxAgeSec = 3600);
   ~Sensor();
 
-  void begin(int pinMode) override;
+  // Mirror unflushed state to RTC memory and pick it up again after a reset.
+  // The active log buffer is limited to SENSOR_RTC_DATA; call before begin().
+  inline void setWarmRestart(bool enable) { _warmRestart = enable; }
+
+  void begin(int pinMode);
   void update(time_t currentTime);
-  void update() override;
+  void update();
   
   void emptyLogFile();
 
+  inline uint16_t pulses() const { return _pulseCount; }             // Current interval
+  inline uint32_t closedTime() const { return _closedTime; }          // Last closed interval, 0 before the first
+  inline uint16_t closedCount() const { return _closedCount; }
+  inline uint16_t edgeOverflows() const { return _edges.overflows(); }  // Edges lost because the ring was full
+  inline const SegmentLog& segments() const { return _segments; }
+  inline const Rollup& hourly() const { return _hourly; }
+  inline const Rollup& daily() const { return _daily; }
+  inline uint32_t maxWriteStall() const { return _writer.maxStallMicros(); }  // Longest log write in one update, in us
+
+  // Inter-pulse timing. Every pulse is timed from its debounced falling edge,
+  // to the microsecond in INTERRUPT mode and to SENSOR_POLL_MS when polling.
+  inline void setImpulsesPerKWh(uint16_t impulses) { _impulsesPerKWh = impulses; }
+  inline uint32_t pulseInterval() const { return _pulseInterval; }   // us between the last two pulses, 0 if unknown
+  float power() const;
+
+  // Log the time of every pulse to _sensor_capture_path for the next seconds
+  // (up to SENSOR_CAPTURE_SEC); a new capture replaces the last one
+  bool startCapture(uint16_t seconds);
+  void stopCapture();
+  inline bool capturing() const { return _capturing; }
+
 private:
+  static void onEdge(void* arg);
+  static void onTask(void* arg);
+  void drainEdges();
+  inline void sample(bool level, uint32_t nowMicros);
+  void timePulse(uint32_t atMicros);
+  void flushCapture();
+
   void closeLogFile();
   void createLogFile();
+  void migrateLogFile();
+
+  bool restoreSnapshot();
+  void saveSnapshot();
+  inline uint32_t snapshotChecksum() const;
 
-  void resetTimestamp(time_t currentTime);
+  void rebase(uint32_t base);
+  void logInterval(uint32_t offset);
   void saveLogEntry(uint16_t offset);
-  void writeLogEntryBuffer(size_t count);
 
   inline uint32_t calcOffset(time_t currentTime);
 };
 
+extern const char _sensorlog_dir[];
 extern const char _sensorlog_path[];
+extern const char _sensorlog_v1_path[];
+extern const char _sensor_capture_path[];
 
@@ -1,14 +1,19 @@
 #include <debouncer.h>
 #include <eventlog.h>
 #include <LittleFS.h>
+#include <metrics.h>
+#include <scheduler.h>
 
 #include "global.h"
 #include "wifi.h"
 
 ColorLED _led(D1, D2, D5);
-Sensor _sensor(D6, 15, 30);
+Sensor _sensor(D6, 30, Sensor::INTERRUPT, SENSOR_RTC_DATA);  // resets keep the buffer in RTC memory
 WiFiManager _wifi("elmer", "1", 12, 00, 20);  // 12:00-12:20
 
+Counter _loops("elmer_loop_iterations_total", "loop() iterations");
+Histogram _loopTime("elmer_loop_seconds", "Tasks run by one loop(), sleep excluded");
+
 void setup()
 {
   Serial.begin(115200);
@@ -21,19 +26,28 @@ void setup()
     _led.error();
   }
 
-  if (!_events.begin())
+  // BINARY rather than the library's TEXT default: about 0.3 us and 18 bytes
+  // a message in BM_EventLogLog_Binary, against 2.5 us and 42 bytes as text
+  if (!_events.begin(EventLog::BINARY))
     _led.error();
 
+  _sensor.setWarmRestart(true);
   _sensor.begin(INPUT_PULLUP);
   _wifi.begin();
-  _events.log(EventLog::INFO, "System started");
+  _led.play(LED_PATTERN_HEARTBEAT);
+  _events.log(EventLog::INFO, PSTR("System started"));
 }
 
+// Subsystems register their own tasks in begin(); loop() only runs what is due
+// and sleeps otherwise. delay() keeps the WiFi stack and async server going.
 void loop()
 {
-  time_t now = time(nullptr);
+  uint32_t sleepMs;
+  {
+    MetricTimer timer(_loopTime);
+    sleepMs = _scheduler.run();
+  }
 
-  _led.update();
-  _sensor.update(now);
-  _wifi.update(now);
+  _loops.add();
+  delay(sleepMs);
 }
@@ -0,0 +1,74 @@
+// Generated by util/mkui from ui/; do not edit.
+#pragma once
+
+#include <Arduino.h>
+
+struct UiAsset {
+  const char* path;
+  const char* type;
+  const uint8_t* data;   // gzipped, in flash
+  size_t len;
+  const char* etag;      // quoted
+  bool versioned;        // only requested with ?v=<etag>, so it never changes
+};
+
+static const uint8_t _ui_app_js[] PROGMEM = {
+  0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x55, 0x50, 0x3d, 0x4f, 0xc3, 0x30,
+  0x10, 0xdd, 0xf3, 0x2b, 0x6e, 0xb3, 0xa3, 0x22, 0x37, 0x0b, 0x0b, 0x81, 0x05, 0x04, 0x12, 0x0c,
+  0x30, 0x14, 0xa9, 0x03, 0x30, 0x18, 0xe7, 0x9a, 0x5a, 0x38, 0xe7, 0x2a, 0xbe, 0x36, 0x45, 0xa8,
+  0xff, 0x9d, 0x73, 0xfa, 0x01, 0x5d, 0x6c, 0xdf, 0xf9, 0xbd, 0x77, 0xef, 0x9d, 0x5e, 0xac, 0xc9,
+  0xb1, 0x8f, 0x04, 0xba, 0x84, 0x9f, 0x62, 0x63, 0x7b, 0x58, 0xc5, 0x01, 0x7b, 0xb8, 0x81, 0x26,
+  0xba, 0x75, 0x87, 0xc4, 0xa6, 0x45, 0xbe, 0x0f, 0x98, 0x9f, 0xb7, 0xdf, 0x8f, 0x8d, 0x56, 0x23,
+  0x40, 0x95, 0x75, 0x71, 0xe2, 0xba, 0x48, 0x84, 0x8e, 0x4f, 0x12, 0x29, 0xba, 0x2f, 0x64, 0xd1,
+  0x20, 0x1c, 0x60, 0x8e, 0x9f, 0xb3, 0xb1, 0xd6, 0x6a, 0x48, 0x57, 0xd3, 0xa9, 0x82, 0x09, 0x84,
+  0xe8, 0x6c, 0x66, 0x9a, 0x65, 0x4c, 0x2c, 0xb5, 0x9a, 0x06, 0xbf, 0xc1, 0xac, 0xb9, 0xa7, 0x9a,
+  0x48, 0x1d, 0xa6, 0x64, 0x5b, 0x14, 0x91, 0x3f, 0x8b, 0xb8, 0x11, 0x13, 0xc7, 0x21, 0xc1, 0x13,
+  0x26, 0xf9, 0x1e, 0x9b, 0xa6, 0xb1, 0x6c, 0x0d, 0xf7, 0xbe, 0xd3, 0xa5, 0x49, 0xab, 0xe0, 0x65,
+  0xda, 0x3b, 0x8d, 0x26, 0x63, 0x0f, 0x3a, 0xe3, 0xbd, 0x60, 0xab, 0x5a, 0xae, 0xeb, 0x3d, 0xd5,
+  0x04, 0xa4, 0x96, 0x97, 0xd2, 0x99, 0x4c, 0x8e, 0x9a, 0x3d, 0xda, 0xc6, 0x53, 0x2b, 0xc8, 0xa7,
+  0xd9, 0xcb, 0xb3, 0x59, 0xd9, 0x3e, 0xa1, 0x1e, 0xd1, 0x6f, 0xfe, 0x43, 0xc4, 0xfc, 0x02, 0x24,
+  0x85, 0x02, 0x4f, 0x47, 0x68, 0x59, 0x8c, 0xeb, 0x30, 0x8c, 0x5b, 0xbe, 0x8b, 0xc4, 0xe2, 0x45,
+  0xd8, 0x87, 0x4f, 0x33, 0x18, 0x8e, 0x0f, 0x7e, 0x8b, 0x8d, 0xae, 0xca, 0x1c, 0x13, 0xe6, 0xaa,
+  0x2e, 0x76, 0xc5, 0xee, 0x5f, 0x4e, 0x17, 0x62, 0x3a, 0x4f, 0x99, 0xcd, 0x24, 0xe4, 0x57, 0xdf,
+  0x61, 0x5c, 0xb3, 0x3e, 0x2c, 0xf7, 0x02, 0x2e, 0xab, 0xaa, 0x12, 0x0f, 0xbb, 0xac, 0x70, 0xda,
+  0xb8, 0x14, 0xa5, 0x9c, 0xbf, 0x34, 0x43, 0x81, 0x4d, 0xc8, 0x01, 0x00, 0x00,
+};
+
+static const uint8_t _ui_index_html[] PROGMEM = {
+  0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x75, 0x92, 0xc1, 0x4e, 0xc3, 0x30,
+  0x0c, 0x86, 0x5f, 0x25, 0xe4, 0xc0, 0x89, 0xad, 0x5a, 0x07, 0xac, 0x13, 0x49, 0x39, 0x6c, 0xbb,
+  0x21, 0x81, 0x34, 0x04, 0xe2, 0x98, 0x26, 0xee, 0x1a, 0x48, 0x93, 0x2a, 0xf1, 0x5a, 0xed, 0xed,
+  0x49, 0xbb, 0xa2, 0x4d, 0x62, 0x3b, 0x44, 0x96, 0xfd, 0xdb, 0x5f, 0x9c, 0x5f, 0x61, 0x37, 0xeb,
+  0xd7, 0xd5, 0xfb, 0xd7, 0xdb, 0x86, 0x54, 0x58, 0x9b, 0x9c, 0xb0, 0xbf, 0x00, 0x42, 0xc5, 0x50,
+  0x03, 0x0a, 0x22, 0x2b, 0xe1, 0x03, 0x20, 0xa7, 0x7b, 0x2c, 0x27, 0x19, 0xfd, 0x2b, 0x5b, 0x51,
+  0x03, 0xa7, 0xad, 0x86, 0xae, 0x71, 0x1e, 0x29, 0x91, 0xce, 0x22, 0xd8, 0xd8, 0xd6, 0x69, 0x85,
+  0x15, 0x57, 0xd0, 0x6a, 0x09, 0x93, 0x21, 0xb9, 0x23, 0xda, 0x6a, 0xd4, 0xc2, 0x4c, 0x82, 0x14,
+  0x06, 0xf8, 0xac, 0x87, 0xa0, 0x46, 0x03, 0xf9, 0xc6, 0xd4, 0xe0, 0x59, 0x72, 0x4c, 0x08, 0x33,
+  0xda, 0xfe, 0x10, 0x0f, 0x86, 0xd3, 0x80, 0x07, 0x03, 0xa1, 0x02, 0x88, 0xe8, 0xca, 0x43, 0x39,
+  0x56, 0xa6, 0x32, 0x84, 0xe7, 0x96, 0x67, 0x8f, 0x69, 0xa9, 0x44, 0x3a, 0x4f, 0x65, 0xb9, 0x5c,
+  0xcc, 0xb2, 0x87, 0x1e, 0x98, 0x8c, 0x4b, 0x17, 0x4e, 0x1d, 0x62, 0x68, 0x88, 0x56, 0x9c, 0x36,
+  0xae, 0x03, 0x4f, 0xf3, 0x5b, 0xab, 0x44, 0xa8, 0x9e, 0xc8, 0x27, 0x4b, 0x9a, 0xa8, 0x89, 0x11,
+  0x09, 0x6d, 0xdc, 0x78, 0x62, 0xdc, 0x8e, 0xe6, 0xac, 0xd8, 0x23, 0x3a, 0x9b, 0xaf, 0x5d, 0x67,
+  0x8d, 0x13, 0x8a, 0x6c, 0x7a, 0x8d, 0xbc, 0xb8, 0x5d, 0x60, 0xc9, 0xa8, 0xb1, 0x44, 0xc4, 0x3e,
+  0x3f, 0x9c, 0x13, 0x24, 0x80, 0x0d, 0xce, 0x5f, 0xa1, 0x6c, 0x07, 0xf1, 0x3f, 0xe6, 0xd2, 0x78,
+  0x7c, 0x5b, 0x7b, 0x42, 0x9c, 0x4d, 0x12, 0x11, 0xc8, 0x6a, 0xfb, 0x71, 0x05, 0xa0, 0xc0, 0x00,
+  0x42, 0x0f, 0x08, 0x67, 0x0b, 0x0c, 0xc5, 0x4b, 0xf7, 0x06, 0xe9, 0x75, 0x83, 0x24, 0x78, 0xc9,
+  0xa9, 0x68, 0x9a, 0xe9, 0x77, 0xef, 0x67, 0x31, 0xbf, 0x5f, 0x64, 0xf3, 0xe8, 0xe7, 0x52, 0x2d,
+  0x8a, 0x54, 0x94, 0x11, 0x94, 0x1c, 0x1b, 0x7b, 0x63, 0x47, 0x47, 0x93, 0xe1, 0x73, 0xfc, 0x02,
+  0x8c, 0x07, 0xdb, 0x94, 0x33, 0x02, 0x00, 0x00,
+};
+
+static const uint8_t _ui_style_css[] PROGMEM = {
+  0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x4b, 0xca, 0x4f, 0xa9, 0xac, 0x4e,
+  0xcb, 0xcf, 0x2b, 0xd1, 0x4d, 0x4b, 0xcc, 0xcd, 0xcc, 0xa9, 0xb4, 0x2a, 0x4e, 0xcc, 0x2b, 0xd6,
+  0x2d, 0x4e, 0x2d, 0xca, 0x4c, 0xb3, 0xce, 0x4d, 0x2c, 0x4a, 0xcf, 0xcc, 0xb3, 0x32, 0x4c, 0xcd,
+  0xad, 0x55, 0x2e, 0xc8, 0x2f, 0x4f, 0x2d, 0x82, 0x28, 0x2c, 0xce, 0xac, 0x4a, 0xb5, 0x32, 0x4a,
+  0xcd, 0x85, 0xc9, 0x1b, 0x28, 0x00, 0xa1, 0x9e, 0x29, 0x50, 0x15, 0x00, 0x40, 0x0b, 0x3b, 0xf7,
+  0x4d, 0x00, 0x00, 0x00,
+};
+
+static const UiAsset _uiAssets[] = {
+  { "/app.js", "application/javascript", _ui_app_js, 301, "\"b347832329d7b2af\"", true },
+  { "/", "text/html", _ui_index_html, 328, "\"2d691d99396cf380\"", false },
+  { "/style.css", "text/css", _ui_style_css, 84, "\"862fda232cf97185\"", true },
+};
@@ -1,9 +1,11 @@
 #include <LittleFS.h>
 #include <eventlog.h>
+#include <metrics.h>
 
 #include "wifi.h"
 #include "global.h"
 #include "sensor.h"
+#include "ui.h"
 
 // Global implementation
 const char OTA_AUTH[]     = "auth";
@@ -13,6 +15,16 @@ const char OTA_RECEIVE[]  = "receive";
 const char OTA_END[]      = "end";
 const char OTA_UNKNOWN[]  = "n/a";
 
+static Counter _requests("elmer_http_requests_total", "HTTP requests handled");
+static Histogram _otaTime("elmer_ota_handle_seconds", "ArduinoOTA.handle() while the AP runs");
+static Gauge _freeHeap("elmer_heap_free_bytes", "Free heap", []() -> int32_t { return ESP.getFreeHeap(); });
+static Gauge _maxBlock("elmer_heap_max_block_bytes", "Largest free heap block", []() -> int32_t { return ESP.getMaxFreeBlockSize(); });
+static Gauge _fragmentation("elmer_heap_fragmentation_percent", "Heap fragmentation", []() -> int32_t { return ESP.getHeapFragmentation(); });
+static Gauge _uptime("elmer_uptime_seconds", "Seconds since boot", []() -> int32_t { return millis() / 1000; });
+static Gauge _edgeOverflows("elmer_sensor_edge_overflows", "Edges lost because the ring was full", []() -> int32_t { return _sensor.edgeOverflows(); });
+static Gauge _power("elmer_power_watts", "Power from the last interval between pulses", []() -> int32_t { return _sensor.power(); });
+static Gauge _writeStall("elmer_log_max_stall_microseconds", "Longest sensor log write in one update", []() -> int32_t { return _sensor.maxWriteStall(); });
+
 // Class implementation
 WiFiManager::WiFiManager(const char* ssid, const char* password, uint8_t hour, uint8_t minute, uint8_t duration)
 {
@@ -23,17 +35,24 @@ WiFiManager::WiFiManager(const char* ssid, const char* password, uint8_t hour, u
     _endMinutes = _startMinutes + duration;
 
     _apRunning = false;
+    _checkedMinute = 0;
+
+    _windowTask = -1;
+    _otaTask = -1;
 }
 
 void WiFiManager::begin()
 {
+  _windowTask = _scheduler.every("ap-window", WIFI_WINDOW_MS, onWindowTask, this);
+  _otaTask = _scheduler.add("ota", onOtaTask, this, WIFI_OTA_MS);
+
   // Initialize OTA
   ArduinoOTA.onStart([]() {
-    _events.log(EventLog::ERROR, "OTA Start");
+    _events.log(EventLog::ERROR, PSTR("OTA Start"));
   });
   
   ArduinoOTA.onEnd([]() {
-    _events.log(EventLog::ERROR, "OTA End");
+    _events.log(EventLog::ERROR, PSTR("OTA End"));
   });
   
   ArduinoOTA.onProgress([](unsigned int progress, unsigned int total) {
@@ -62,38 +81,72 @@ void WiFiManager::begin()
         reason = OTA_UNKNOWN;
     }
 
-    _events.log(EventLog::ERROR, "OTA[%u]:%s failed", error, reason);
+    _events.log(EventLog::ERROR, PSTR("OTA[%u]:%s failed"), error, reason);
   });
 
-  // Initialize webserver
-  _server.on("/", HTTP_GET, [](AsyncWebServerRequest *request) {
-    request->send(200, "text/html", R"rawliteral(
-      <!DOCTYPE html>
-      <html>
-      <head><title>Logs</title></head>
-      <body>
-        <a href="event-log"><button>Download Event Logs</button></a><br><br>
-        <a href="sensor-log"><button>Download Sensor Logs</button></a>
-        <a href="delete-logs"><button>Delete Logs</button></a>
-      </body>
-      </html>
-    )rawliteral");
-  });
+  // Initialize webserver; the UI comes precompressed from ui.h (util/mkui)
+  for (const UiAsset& asset : _uiAssets) {
+    route(asset.path, [this, &asset](AsyncWebServerRequest *request) {
+        serveAsset(request, asset);
+    });
+  }
 
   // Event log
-  _server.on("/event-log", HTTP_GET, [this](AsyncWebServerRequest *request) {
-      serveLogFile(request, _eventlog_path);
+  route("/event-log", [this](AsyncWebServerRequest *request) {
+      serveEventLog(request);
   });
 
   // Sensor log
-  _server.on("sensor-log", HTTP_GET, [this](AsyncWebServerRequest *request) {
-      serveLogFile(request, _sensorlog_path);
+  route("/sensor-log", [this](AsyncWebServerRequest *request) {
+      serveSensorLog(request);
+  });
+
+  route("/sensor-log.csv", [this](AsyncWebServerRequest *request) {
+      serveSensorExport(request, LogExport::CSV);
+  });
+
+  route("/sensor-log.json", [this](AsyncWebServerRequest *request) {
+      serveSensorExport(request, LogExport::JSON);
+  });
+
+  // Rollups: ?tier=hour|day&from=&to=
+  route("/rollup", [this](AsyncWebServerRequest *request) {
+      serveRollup(request);
+  });
+
+  // Scheduler statistics
+  route("/tasks", [this](AsyncWebServerRequest *request) {
+      serveTasks(request);
   });
 
+  // Current power, from the last interval between pulses
+  route("/power", [](AsyncWebServerRequest *request) {
+      char json[96];
+      snprintf(json, sizeof(json), "{\"watts\":%.1f,\"interval\":%lu,\"capturing\":%s}",
+               _sensor.power(), (unsigned long)_sensor.pulseInterval(), _sensor.capturing() ? "true" : "false");
+      request->send(200, "application/json", json);
+  });
+
+  // Pulse times: ?seconds= starts a capture, otherwise the last one is returned
+  route("/capture", [this](AsyncWebServerRequest *request) {
+      serveCapture(request);
+  });
+
+  // Prometheus metrics
+  route("/metrics", [](AsyncWebServerRequest *request) {
+      AsyncResponseStream *response = request->beginResponseStream("text/plain; version=0.0.4");
+      Metric::write(*response);
+      request->send(response);
+  });
+
+  // Readings pushed every LIVE_PERIOD_MS over a WebSocket
+  _live.begin(_server);
+
   // Delete log
-  _server.on("delete-logs", HTTP_GET, [this](AsyncWebServerRequest *request) {
+  route("/delete-logs", [this](AsyncWebServerRequest *request) {
       _events.emptyLogFile();
       _sensor.emptyLogFile();
+      request->send(200, "text/plain", "Logs deleted");
   });
 
   _server.begin();
@@ -108,16 +161,19 @@ bool WiFiManager::startAP()
 
     bool success = WiFi.softAP(_ssid, _password);
     if (!success) {
-        _events.log(EventLog::ERROR, "Failed to start Access Point");
+        _events.log(EventLog::ERROR, PSTR("Failed to start Access Point"));
         return false;
     }
 
     _apRunning = true;
     _server.begin();
+    _live.start();
     
     ArduinoOTA.begin();
+    _scheduler.wake(_otaTask);
+    _led.play(LED_PATTERN_SYNC, ColorLED::NOTICE);
 
-    _events.log(EventLog::INFO, "Access Point started. IP: %s", WiFi.softAPIP().toString().c_str());
+    _events.log(EventLog::INFO, PSTR("Access Point started. IP: %s"), WiFi.softAPIP().toString().c_str());
     return true;
 }
 
@@ -127,32 +183,276 @@ void WiFiManager::stopAP()
       return;
     
     _apRunning = false;
+    _scheduler.stop(_otaTask);
+    _live.end();
+    _led.stop(ColorLED::NOTICE);
 
     WiFi.softAPdisconnect(true);
     WiFi.mode(WIFI_OFF);
 
-    _events.log(EventLog::INFO, "Access Point stopped");
+    _events.log(EventLog::INFO, PSTR("Access Point stopped"));
+}
+
+// Registers a GET handler whose requests are counted
+void WiFiManager::route(const char* path, ArRequestHandlerFunction handler)
+{
+  _server.on(path, HTTP_GET, [handler](AsyncWebServerRequest *request) {
+      _requests.add();
+      handler(request);
+  });
+}
+
+void WiFiManager::onWindowTask(void* arg)
+{
+    static_cast<WiFiManager*>(arg)->update(time(nullptr));
+}
+
+void WiFiManager::onOtaTask(void* arg)
+{
+    MetricTimer timer(_otaTime);
+    ArduinoOTA.handle();
 }
 
 void WiFiManager::update(time_t currentTime)
 {
+    // The window only moves in whole minutes
+    uint32_t minute = currentTime / 60;
+    if (minute == _checkedMinute)
+      return;
+    _checkedMinute = minute;
+
     struct tm* now = localtime(&currentTime);
     int currentMinutes = now->tm_hour * 60 + now->tm_min;
 
-    if (!isInWindow(currentMinutes)) {
+    if (isInWindow(currentMinutes))
+      startAP();
+    else
       stopAP();
+}
+
+// Sent gzipped straight from flash, whatever Accept-Encoding says: every
+// browser takes it. The page is revalidated on each visit and costs a 304
+// until a firmware update changes it; the files it refers to by version
+// are cached for good.
+void WiFiManager::serveAsset(AsyncWebServerRequest *request, const UiAsset& asset)
+{
+  AsyncWebServerResponse *response;
+  AsyncWebHeader *header = request->getHeader("If-None-Match");
+
+  if (header && header->value() == asset.etag) {
+    response = request->beginResponse(304);
+  } else {
+    response = request->beginResponse_P(200, asset.type, asset.data, asset.len);
+    response->addHeader("Content-Encoding", "gzip");
+  }
+
+  response->addHeader("ETag", asset.etag);
+  response->addHeader("Cache-Control", asset.versioned ? "public, max-age=31536000, immutable" : "no-cache");
+  request->send(response);
+}
+
+void WiFiManager::serveCapture(AsyncWebServerRequest *request)
+{
+  if (request->hasParam("seconds")) {
+    if (_sensor.startCapture(timeParam(request, "seconds", 0)))
+      request->send(202, "text/plain", "Capture started");
+    else
+      request->send(500, "text/plain", "Capture failed");
+    return;
+  }
+
+  File file = LittleFS.open(_sensor_capture_path, "r");
+  if (!file) {
+    request->send(404, "text/plain", "No capture");
+    return;
+  }
+
+  size_t size = file.size();
+  file.close();
+
+  AsyncWebServerResponse *response = fileRange(request, _sensor_capture_path, 0, size);
+  response->setContentType("application/octet-stream");
+  response->addHeader("Content-Disposition", "attachment; filename=capture.bin");
+  request->send(response);
+}
+
+// One line per task: name, runs, longest run in us, armed
+void WiFiManager::serveTasks(AsyncWebServerRequest *request)
+{
+  AsyncResponseStream *response = request->beginResponseStream("text/plain");
+
+  for (uint8_t id = 0; id < _scheduler.count(); id++) {
+    const SchedulerTask& task = _scheduler.task(id);
+    response->printf("%-10s %10lu %8lu %s\n", task.name, (unsigned long)task.runs,
+                     (unsigned long)task.maxMicros, _scheduler.armed(id) ? "armed" : "idle");
+  }
+  request->send(response);
+}
+
+// Streams [from, to) of a file that may keep growing meanwhile
+AsyncWebServerResponse* WiFiManager::fileRange(AsyncWebServerRequest *request, const char* path, size_t from, size_t to)
+{
+  File file = LittleFS.open(path, "r");
+  if (!file || !file.seek(from))
+    return request->beginResponse(404, "text/plain", "Log file not found");
+
+  size_t remaining = to - from;
+  return request->beginChunkedResponse("text/plain", [file, remaining](uint8_t *buffer, size_t maxLen, size_t index) mutable -> size_t {
+    if (maxLen > remaining)
+      maxLen = remaining;
+
+    size_t size = file.read(buffer, maxLen);
+    remaining -= size;
+    return size;
+  });
+}
+
+// Incremental sync: every log response carries the log's end as a token, both
+// as X-Log-Token and as ETag. ?since=<token> returns only what was appended
+// after it, and If-None-Match with the current ETag gets a bodiless 304.
+bool WiFiManager::notModified(AsyncWebServerRequest *request, const char* etag)
+{
+  AsyncWebHeader *header = request->getHeader("If-None-Match");
+  if (!header || header->value() != etag)
+    return false;
+
+  AsyncWebServerResponse *response = request->beginResponse(304);
+  response->addHeader("ETag", etag);
+  request->send(response);
+  return true;
+}
+
+// etag is the quoted token
+void WiFiManager::sendWithToken(AsyncWebServerRequest *request, AsyncWebServerResponse *response, const char* etag)
+{
+  String token(etag + 1);
+  token.remove(token.length() - 1);
+
+  response->addHeader("ETag", etag);
+  response->addHeader("X-Log-Token", token);
+  response->addHeader("Cache-Control", "no-cache");
+  request->send(response);
+}
+
+uint32_t WiFiManager::timeParam(AsyncWebServerRequest *request, const char* name, uint32_t fallback)
+{
+  if (!request->hasParam(name))
+    return fallback;
+
+  return strtoul(request->getParam(name)->value().c_str(), nullptr, 10);
+}
+
+// Stream the segments as one file, up to the end flushed when the request came in.
+// ?from=&to= (epoch seconds) narrow it to the indexed blocks covering that range;
+// ?since=<segment>.<offset> returns the raw bytes appended after that token.
+void WiFiManager::serveSensorLog(AsyncWebServerRequest *request)
+{
+  const SegmentLog& log = _sensor.segments();
+  LogPosition end = log.end();
+  bool incremental = request->hasParam("since");
+  LogPosition from, to = end;
+  char etag[32];
+
+  snprintf(etag, sizeof(etag), "\"%lu.%lu\"", (unsigned long)end.segment, (unsigned long)end.offset);
+  if (notModified(request, etag))
+    return;
+
+  if (incremental) {
+    char* dot;
+    from.segment = strtoul(request->getParam("since")->value().c_str(), &dot, 10);
+    from.offset = *dot == '.' ? strtoul(dot + 1, nullptr, 10) : 0;
+
+    // A token from the future belongs to a log that has been cleared since
+    if (from.segment > end.segment || (from.segment == end.segment && from.offset > end.offset))
+      from = { log.first(), 0 };
+  } else {
+    from = log.find(timeParam(request, "from", 0));
+    to = log.findAfter(timeParam(request, "to", UINT32_MAX));
+  }
+
+  auto reader = std::make_shared<SegmentReader>(log, from, to, !incremental);
+
+  AsyncWebServerResponse *response = request->beginChunkedResponse("application/octet-stream",
+      [reader](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+    return reader->read(buffer, maxLen);
+  });
+
+  response->addHeader("Content-Disposition", "attachment; filename=sensor.bin");
+  sendWithToken(request, response, etag);
+}
+
+// Decoded log as CSV or JSON, trimmed exactly to ?from=&to=
+void WiFiManager::serveSensorExport(AsyncWebServerRequest *request, LogExport::Format format)
+{
+  const SegmentLog& log = _sensor.segments();
+  uint32_t fromTime = timeParam(request, "from", 0);
+  uint32_t toTime = timeParam(request, "to", UINT32_MAX);
+
+  auto exporter = std::make_shared<LogExport>(log, log.find(fromTime), log.findAfter(toTime), format, fromTime, toTime);
+
+  request->send(request->beginChunkedResponse(format == LogExport::CSV ? "text/csv" : "application/json",
+      [exporter](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+    return exporter->read(buffer, maxLen);
+  }));
+}
+
+void WiFiManager::serveRollup(AsyncWebServerRequest *request)
+{
+  const Rollup* rollup = &_sensor.hourly();
+
+  if (request->hasParam("tier")) {
+    const String& tier = request->getParam("tier")->value();
+    if (tier == "day")
+      rollup = &_sensor.daily();
+    else if (tier != "hour") {
+      request->send(400, "text/plain", "Unknown tier");
       return;
     }
+  }
+
+  auto reader = std::make_shared<RollupReader>(*rollup, timeParam(request, "from", 0), timeParam(request, "to", UINT32_MAX));
 
-    if (startAP())
-      ArduinoOTA.handle();
+  request->send(request->beginChunkedResponse("text/csv", [reader](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+    return reader->read(buffer, maxLen);
+  }));
 }
 
-void WiFiManager::serveLogFile(AsyncWebServerRequest *request, const char* path)
+// Binary event logs are formatted on the way out
+// ?since=<token> returns the messages logged after that token, a byte offset
+// into the log file (text or binary)
+void WiFiManager::serveEventLog(AsyncWebServerRequest *request)
 {
-  File file = LittleFS.open(path, "r");
-  if (file)
-    request->send(file, String(path), "application/octet-stream");
-  else
-    request->send(404, "text/plain", "Log file not found");
+  // Buffered messages belong in the response too
+  _events.sync();
+
+  size_t end = _events.size();
+  size_t since = 0;
+  char etag[32];
+
+  snprintf(etag, sizeof(etag), "\"%lu.%lu\"", (unsigned long)_events.generation(), (unsigned long)end);
+  if (notModified(request, etag))
+    return;
+
+  // ?since=<generation>.<offset>; a token from another generation, or from
+  // the future, belongs to a log that has been emptied since
+  if (request->hasParam("since")) {
+    char* dot;
+    uint32_t generation = strtoul(request->getParam("since")->value().c_str(), &dot, 10);
+    if (*dot == '.' && generation == _events.generation())
+      since = strtoul(dot + 1, nullptr, 10);
+    if (since > end)
+      since = 0;
+  }
+
+  AsyncWebServerResponse *response;
+  if (_events.format() == EventLog::TEXT)
+    response = fileRange(request, _eventlog_path, since, end);
+  else {
+    auto reader = std::make_shared<EventReader>(_eventlog_bin_path, since, end, _events.session());
+    response = request->beginChunkedResponse("text/plain", [reader](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+      return reader->read(buffer, maxLen);
+    });
+  }
+
+  sendWithToken(request, response, etag);
 }
@@ -4,6 +4,15 @@
 #include <ArduinoOTA.h>
 #include <ESP8266WiFi.h>
 #include <ESPAsyncWebServer.h>
+#include <scheduler.h>
+
+#include "livefeed.h"
+#include "logexport.h"
+
+#define WIFI_WINDOW_MS  1000  // AP window check period; the window itself has minute granularity
+#define WIFI_OTA_MS     20    // ArduinoOTA polling period while the AP runs
+
+struct UiAsset;
 
 class WiFiManager
 {
@@ -11,15 +20,30 @@ public:
     WiFiManager(const char* ssid, const char* password, uint8_t hour, uint8_t minute, uint8_t duration);
 
     void begin();
-    void update(time_t currentTime);
+    void update(time_t currentTime);  // Start or stop the AP; runs as a scheduler task
 
 private:
+    static void onWindowTask(void* arg);
+    static void onOtaTask(void* arg);
+
     bool startAP();
     void stopAP();
 
+    void route(const char* path, ArRequestHandlerFunction handler);
+
     inline IPAddress getIP() const { return WiFi.softAPIP(); }   // Get current AP IP
     inline bool isRunning() const { return _apRunning; }          // Check if AP is active
-    void serveLogFile(AsyncWebServerRequest *request, const char* path);
+    AsyncWebServerResponse* fileRange(AsyncWebServerRequest *request, const char* path, size_t from, size_t to);
+    void serveEventLog(AsyncWebServerRequest *request);
+    void serveSensorLog(AsyncWebServerRequest *request);
+    void serveSensorExport(AsyncWebServerRequest *request, LogExport::Format format);
+    void serveRollup(AsyncWebServerRequest *request);
+    void serveTasks(AsyncWebServerRequest *request);
+    void serveCapture(AsyncWebServerRequest *request);
+    void serveAsset(AsyncWebServerRequest *request, const UiAsset& asset);
+    uint32_t timeParam(AsyncWebServerRequest *request, const char* name, uint32_t fallback);
+    bool notModified(AsyncWebServerRequest *request, const char* etag);
+    void sendWithToken(AsyncWebServerRequest *request, AsyncWebServerResponse *response, const char* etag);
 
     inline bool isInWindow(uint16_t currentMinutes) const { return currentMinutes >= _startMinutes && currentMinutes < _endMinutes; }
 
@@ -30,7 +54,12 @@ private:
 
     uint16_t _startMinutes;
     uint16_t _endMinutes;
+    uint32_t _checkedMinute;  // epoch minute of the last window check
+
+    int8_t _windowTask;
+    int8_t _otaTask;
 
     AsyncWebServer _server {80};
+    LiveFeed _live;
 };
 
@@ -0,0 +1,25 @@
+// Shows the power from the /live WebSocket; each message holds one JSON
+// object per line, see LiveFeed.
+(function () {
+  var power = document.getElementById('power');
+
+  function connect() {
+    var socket = new WebSocket('ws://' + location.host + '/live');
+
+    socket.onmessage = function (event) {
+      var lines = event.data.trim().split('\n');
+      for (var i = 0; i < lines.length; i++) {
+        var reading = JSON.parse(lines[i]);
+        if ('w' in reading)
+          power.textContent = reading.w.toFixed(0) + ' W';
+      }
+    };
+
+    // The AP only runs in its window; try again later
+    socket.onclose = function () {
+      setTimeout(connect, 5000);
+    };
+  }
+
+  connect();
+})();